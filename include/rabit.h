@@ -162,6 +162,182 @@ template<typename OP, typename DType>
 inline void Allreduce(DType *sendrecvbuf, size_t count,
                       std::function<void()> prepare_fun);
 #endif  // C++11
+/*!
+ * \brief handle of a non-blocking collective, returned by IAllreduce and IBroadcast
+ */
+class Request {
+ public:
+  /*! \brief an empty request, which is always finished */
+  Request(void) : id_(0) {}
+  /*! \brief construct from request id of engine */
+  explicit Request(uint64_t id) : id_(id) {}
+  /*! \return whether the collective has finished */
+  inline bool Test(void) const;
+  /*! \brief wait until the collective finishes */
+  inline void Wait(void) const;
+
+ private:
+  /*! \brief id of the request in engine */
+  uint64_t id_;
+};
+/*!
+ * \brief starts in-place Allreduce on sendrecvbuf, and returns without waiting for it to finish,
+ *        so that the caller can compute while the data is passed around.
+ *        The non-blocking collectives are done by a progress thread in the order they are issued,
+ *        the buffer must not be touched until the request finishes,
+ *        the blocking collectives and checkpoints wait for all the requests to finish first,
+ *        while GetRank, GetWorldSize, TrackerPrint and VersionNumber return right away.
+ *        this function is NOT thread-safe
+ *
+ * Example Usage: the following code reduces the first half while computing the second half
+ *     ... compute data[0, n)
+ *     Request req = IAllreduce<op::Sum>(&data[0], n);
+ *     ... compute other[0, n)
+ *     req.Wait();
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param count number of elements to be reduced
+ * \param prepare_fun Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+ *                    will be called in the progress thread before performing Allreduce in order to initialize the data in sendrecvbuf.
+ *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to pass into the lazy preprocessing function, it must be valid until the request finishes
+ * \return the request handle
+ * \tparam OP see namespace op, reduce operator
+ * \tparam DType data type
+ */
+template<typename OP, typename DType>
+inline Request IAllreduce(DType *sendrecvbuf, size_t count,
+                          void (*prepare_fun)(void *arg) = NULL,
+                          void *prepare_arg = NULL);
+/*!
+ * \brief starts Broadcast, and returns without waiting for it to finish, see also IAllreduce
+ * \param sendrecv_data the pointer to the send/receive buffer,
+ * \param size the data size
+ * \param root the process root
+ * \return the request handle
+ */
+inline Request IBroadcast(void *sendrecv_data, size_t size, int root);
+/*!
+ * \brief performs in-place Allreduce on sendrecvbuf, where most of the elements are zero,
+ *        for example, gradient of a shard of high dimensional sparse data.
+ *        Only non-zero elements are passed between processes, segments of the data
+ *        that are dense enough are passed in dense format.
+ *        Zero must be the identity of the reducer, as elements that are zero in every process are never reduced,
+ *        so only op::Sum and op::BitOR are supported, other reducers are rejected
+ *        this function is NOT thread-safe
+ *
+ * Example Usage: the following code gives sum of the result
+ *     vector<float> grad(num_feature);
+ *     ... only a few elements of grad are set in each process
+ *     SparseAllreduce<op::Sum>(&grad[0], grad.size());
+ *     ...
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param count number of elements to be reduced
+ * \param prepare_fun Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+ *                    will be called by the function before performing Allreduce in order to initialize the data in sendrecvbuf.
+ *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to pass into the lazy preprocessing function 
+ * \tparam OP see namespace op, reduce operator 
+ * \tparam DType data type
+ */
+template<typename OP, typename DType>
+inline void SparseAllreduce(DType *sendrecvbuf, size_t count,
+                            void (*prepare_fun)(void *arg) = NULL,
+                            void *prepare_arg = NULL);
+/*!
+ * \brief performs in-place Reduce on sendrecvbuf, only the root process gets the result
+ *        the content of sendrecvbuf in other processes is undefined after the call
+ *        this function is NOT thread-safe
+ *        NOTE: the saving of traffic only applies to the engines without fault tolerance,
+ *        the robust engine runs a full Allreduce, so that a restarted root can recover the result from any process,
+ *        Reduce costs the same as Allreduce there
+ *
+ * Example Usage: the following code gives sum of the result in process 0
+ *     vector<int> data(10);
+ *     ...
+ *     Reduce<op::Sum>(&data[0], data.size(), 0);
+ *     ...
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param count number of elements to be reduced
+ * \param root the rank of the process to get the result
+ * \param prepare_fun Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+ *                    will be called by the function before performing Reduce in order to initialize the data in sendrecvbuf.
+ *                     If the result of Reduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to pass into the lazy preprocessing function 
+ * \tparam OP see namespace op, reduce operator 
+ * \tparam DType data type
+ */
+template<typename OP, typename DType>
+inline void Reduce(DType *sendrecvbuf, size_t count, int root,
+                   void (*prepare_fun)(void *arg) = NULL,
+                   void *prepare_arg = NULL);
+/*!
+ * \brief performs in-place ReduceScatter on sendrecvbuf
+ *        the buffer is divided into consecutive blocks, one for each process,
+ *        after the call, only the block of the current process is guaranteed to contain the reduced result
+ *        this function is NOT thread-safe
+ *        NOTE: the saving of traffic only applies to the engines without fault tolerance,
+ *        the robust engine runs a full Allreduce, so that the cached result can recover the block of any process
+ *
+ * Example Usage: the following code sums up data, and each process gets the result of 10 elements
+ *     vector<int> data(10 * GetWorldSize());
+ *     vector<size_t> counts(GetWorldSize(), 10);
+ *     ...
+ *     ReduceScatter<op::Sum>(&data[0], counts);
+ *     // data[10 * GetRank()], ..., data[10 * GetRank() + 9] contains the result
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param counts number of elements in the block of each process, size must equal GetWorldSize()
+ * \param prepare_fun Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+ *                    will be called by the function before performing ReduceScatter in order to initialize the data in sendrecvbuf.
+ *                     If the result of ReduceScatter can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to pass into the lazy preprocessing function 
+ * \tparam OP see namespace op, reduce operator 
+ * \tparam DType data type
+ */
+template<typename OP, typename DType>
+inline void ReduceScatter(DType *sendrecvbuf, const std::vector<size_t> &counts,
+                          void (*prepare_fun)(void *arg) = NULL,
+                          void *prepare_arg = NULL);
+/*!
+ * \brief performs in-place Allgather on sendrecvbuf
+ *        the buffer is divided into GetWorldSize() blocks of count elements,
+ *        each process fills in the block GetRank(), after the call every process has all the blocks
+ *        this function is NOT thread-safe
+ *
+ * Example Usage: the following code collects 2 statistics from every process
+ *     vector<float> stats(2 * GetWorldSize());
+ *     stats[2 * GetRank()] = ...; stats[2 * GetRank() + 1] = ...;
+ *     Allgather(&stats[0], 2);
+ * \param sendrecvbuf buffer for both sending and receiving data, contains count * GetWorldSize() elements
+ * \param count number of elements in the block of each process
+ * \tparam DType data type
+ */
+template<typename DType>
+inline void Allgather(DType *sendrecvbuf, size_t count);
+/*!
+ * \brief performs in-place Allgather on sendrecvbuf, where the blocks of processes can have different sizes,
+ *        block i contains counts[i] elements and follows block i - 1,
+ *        each process fills in the block GetRank(), after the call every process has all the blocks
+ *        this function is NOT thread-safe
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param counts number of elements in the block of each process, size must equal GetWorldSize()
+ * \tparam DType data type
+ */
+template<typename DType>
+inline void Allgatherv(DType *sendrecvbuf, const std::vector<size_t> &counts);
+/*!
+ * \brief gathers variable-size data of all processes, the size of the blocks is exchanged first
+ *
+ * Example Usage: every process gets the concatenation of data of all processes, ordered by rank
+ *     vector<int> data; 
+ *     ... fill in data of current process
+ *     Allgatherv(&data);
+ * \param sendrecv_data the data of the current process as input, concatenation of data of all processes as output
+ * \param out_counts if not NULL, used to store the number of elements contributed by each process
+ * \tparam DType data type
+ */
+template<typename DType>
+inline void Allgatherv(std::vector<DType> *sendrecv_data,
+                       std::vector<size_t> *out_counts = NULL);
 /*!
  * \brief loads the latest check point
  * \param global_model pointer to the globally shared model/state
@@ -324,6 +500,92 @@ class SerializeReducer {
   /*! \brief temporal buffer used to do reduce*/
   std::string buffer_;
 };
+/*!
+ * \brief batch of in-place Allreduce operations that are done together,
+ *  the buffers added to the batch are packed into one message and reduced by a single Allreduce,
+ *  so the batch pays the latency of one Allreduce, and in fault tolerant mode
+ *  it takes one sequence number and one round of recovery check for all the buffers
+ *
+ * Example Usage: the following code sums up a vector and a scalar of different types
+ * \code{.cpp}
+ * rabit::AllreduceBatch batch;
+ * batch.Add<op::Sum>(&data[0], data.size());
+ * batch.Add<op::Max>(&value, 1);
+ * batch.Run();
+ * \endcode
+ */
+class AllreduceBatch {
+ public:
+  AllreduceBatch(void);
+  /*!
+   * \brief add a buffer to the batch, the buffer is reduced when Run is called
+   * \param sendrecvbuf buffer for both sending and receiving data, it must be valid until Run returns
+   * \param count number of elements to be reduced
+   * \tparam OP see namespace op, reduce operator
+   * \tparam DType data type
+   */
+  template<typename OP, typename DType>
+  inline void Add(DType *sendrecvbuf, size_t count);
+  /*!
+   * \brief perform in-place Allreduce on all the buffers added, the batch is empty after the call
+   *   all the nodes must add the same sequence of operators, types and counts
+   * \param prepare_fun Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Allreduce, to initialize the data in the buffers.
+   *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to pass into the lazy preprocessing function
+   */
+  inline void Run(void (*prepare_fun)(void *arg) = NULL,
+                  void *prepare_arg = NULL);
+#if __cplusplus >= 201103L
+  /*!
+   * \brief perform in-place Allreduce on all the buffers added, with lambda function as preprocessor
+   * \param prepare_fun lambda function executed to prepare the data, if necessary
+   */
+  inline void Run(std::function<void()> prepare_fun);
+#endif
+
+ private:
+  /*! \brief a buffer in the batch */
+  struct Entry {
+    /*! \brief the buffer */
+    void *ptr;
+    /*! \brief number of elements and number of bytes of each element */
+    size_t count, type_nbytes;
+    /*! \brief number of elements of the buffer in each packed element */
+    size_t slot_count;
+    /*! \brief offset of the buffer in each packed element */
+    size_t offset;
+    /*! \brief reduce function of the buffer */
+    engine::IEngine::ReduceFunction *reducer;
+    /*! \brief data type and operator, which are also written in the header of packed elements */
+    engine::mpi::DataType dtype;
+    engine::mpi::OpType op;
+  };
+  // reduce function of the packed elements, the layout is read from the header of each element
+  inline static void Reduce_(const void *src_, void *dst_, int len, const MPI::Datatype &dtype);
+  // reduce function of integer type given by dtype, type_nbytes is set to the size of the type
+  template<typename OP>
+  inline static engine::IEngine::ReduceFunction *IntReducer_(int dtype, size_t *type_nbytes);
+  // reduce function of any type given by dtype, type_nbytes is set to the size of the type
+  template<typename OP>
+  inline static engine::IEngine::ReduceFunction *NumReducer_(int dtype, size_t *type_nbytes);
+  // pack the buffers after calling the user's prepare function
+  inline static void Prepare_(void *arg);
+  /*! \brief function handle to do reduce */
+  engine::ReduceHandle handle_;
+  /*! \brief buffers added to the batch */
+  std::vector<Entry> entries_;
+  /*!
+   * \brief the packed data, each element starts with a header of the number of buffers
+   *  and the type, operator and slot count of each buffer, followed by a slice of every buffer
+   */
+  std::vector<uint64_t> packed_;
+  /*! \brief number of packed elements and number of bytes of each element */
+  size_t nelem_, elem_nbytes_;
+  /*! \brief the user's prepare function during Run */
+  void (*prepare_fun_)(void *arg);
+  void *prepare_arg_;
+};
 }  // namespace rabit
 // implementation of template functions
 #include "./rabit/rabit-inl.h"
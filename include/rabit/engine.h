@@ -7,6 +7,7 @@
 #ifndef RABIT_ENGINE_H_
 #define RABIT_ENGINE_H_
 #include <string>
+#include <vector>
 #include "../rabit_serializable.h"
 
 namespace MPI {
@@ -59,6 +60,49 @@ class IEngine {
                          ReduceFunction reducer,
                          PreprocFunction prepare_fun = NULL,
                          void *prepare_arg = NULL) = 0;
+  /*!
+   * \brief performs in-place Allreduce on sendrecvbuf, where most of the elements are zero
+   *        only non-zero elements are sent, segments of the data that are dense enough
+   *        are sent in dense format. Elements whose bytes are all zero are considered as zero,
+   *        reducer must keep such elements as identity, e.g. sum
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and receiving data
+   * \param type_nbytes the number of bytes the type has
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \param prepare_func Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Allreduce in order to initialize the data in sendrecvbuf.
+   *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to pass into the lazy preprocessing function
+   */
+  virtual void SparseAllreduce(void *sendrecvbuf_,
+                               size_t type_nbytes,
+                               size_t count,
+                               ReduceFunction reducer,
+                               PreprocFunction prepare_fun = NULL,
+                               void *prepare_arg = NULL) = 0;
+  /*!
+   * \brief performs in-place Reduce, on sendrecvbuf
+   *        the reduced result is only stored in the root node, content of sendrecvbuf
+   *        in other nodes is undefined after the call
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and receiving data
+   * \param type_nbytes the number of bytes the type has
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \param root the root worker id to get the result
+   * \param prepare_func Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Reduce in order to initialize the data in sendrecvbuf.
+   *                     If the result of Reduce can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to pass into the lazy preprocessing function
+   */
+  virtual void Reduce(void *sendrecvbuf_,
+                      size_t type_nbytes,
+                      size_t count,
+                      ReduceFunction reducer,
+                      int root,
+                      PreprocFunction prepare_fun = NULL,
+                      void *prepare_arg = NULL) = 0;
   /*!
    * \brief broadcasts data from root to every other node
    * \param sendrecvbuf_ buffer for both sending and receiving data
@@ -66,6 +110,45 @@ class IEngine {
    * \param root the root worker id to broadcast the data
    */
   virtual void Broadcast(void *sendrecvbuf_, size_t size, int root) = 0;
+  /*!
+   * \brief performs in-place ReduceScatter, on sendrecvbuf
+   *        the data is divided into consecutive blocks, one for each node,
+   *        block i contains counts[i] elements. After the call, the block of current rank
+   *        contains the reduced result of the block, content of other blocks is undefined
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and receiving data
+   * \param type_nbytes the number of bytes the type has
+   * \param counts number of elements in the block of each node, size must equal world size
+   * \param reducer reduce function
+   * \param prepare_func Lazy preprocessing function, if it is not NULL, prepare_fun(prepare_arg)
+   *                     will be called by the function before performing ReduceScatter in order to initialize the data in sendrecvbuf.
+   *                     If the result of ReduceScatter can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to pass into the lazy preprocessing function
+   */
+  virtual void ReduceScatter(void *sendrecvbuf_,
+                             size_t type_nbytes,
+                             const std::vector<size_t> &counts,
+                             ReduceFunction reducer,
+                             PreprocFunction prepare_fun = NULL,
+                             void *prepare_arg = NULL) = 0;
+  /*!
+   * \brief performs in-place Allgather, on sendrecvbuf
+   *        the data is divided into world size blocks of equal size, block i belongs to node i.
+   *        Each node fills in its own block, after the call every node has the blocks of all nodes
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and receiving data, contains size * world_size bytes
+   * \param size the size of the block of each node in bytes
+   */
+  virtual void Allgather(void *sendrecvbuf_, size_t size) = 0;
+  /*!
+   * \brief performs in-place Allgatherv, on sendrecvbuf
+   *        the same as Allgather, except that the blocks can have different sizes,
+   *        block i contains sizes[i] bytes and starts right after block i - 1
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and receiving data
+   * \param sizes size of the block of each node in bytes, size must equal world size
+   */
+  virtual void Allgatherv(void *sendrecvbuf_, const std::vector<size_t> &sizes) = 0;
   /*!
    * \brief explicitly re-initialize everything before calling LoadCheckPoint
    *    call this function when IEngine throws an exception,
@@ -162,6 +245,11 @@ void Init(int argc, char *argv[]);
 void Finalize(void);
 /*! \brief singleton method to get engine */
 IEngine *GetEngine(void);
+/*!
+ * \brief singleton method to get engine for collectives and checkpoints,
+ *  waits until the non-blocking collectives issued before finish, as they use the links until then
+ */
+IEngine *GetIdleEngine(void);
 
 /*! \brief namespace that contains stubs to be compatible with MPI */
 namespace mpi {
@@ -207,6 +295,119 @@ void Allreduce_(void *sendrecvbuf,
                 mpi::OpType op,
                 IEngine::PreprocFunction prepare_fun = NULL,
                 void *prepare_arg = NULL);
+/*!
+ * \brief perform in-place Allreduce of data that is mostly zero, on sendrecvbuf
+ *   this is an internal function used by rabit to be able to compile with MPI
+ *   do not use this function directly
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param type_nbytes the number of bytes the type has
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \param dtype the data type
+ * \param op the reduce operator type
+ * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+ *                     will be called by the function before performing Allreduce, to initialize the data in sendrecvbuf_.
+ *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to pass into the lazy preprocessing function.
+ */
+void SparseAllreduce_(void *sendrecvbuf,
+                      size_t type_nbytes,
+                      size_t count,
+                      IEngine::ReduceFunction red,
+                      mpi::DataType dtype,
+                      mpi::OpType op,
+                      IEngine::PreprocFunction prepare_fun = NULL,
+                      void *prepare_arg = NULL);
+/*!
+ * \brief perform in-place Reduce, on sendrecvbuf
+ *   this is an internal function used by rabit to be able to compile with MPI
+ *   do not use this function directly
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param type_nbytes the number of bytes the type has
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \param dtype the data type
+ * \param op the reduce operator type
+ * \param root the root worker id to get the result
+ * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+ *                     will be called by the function before performing Reduce, to initialize the data in sendrecvbuf_.
+ *                     If the result of Reduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to pass into the lazy preprocessing function.
+ */
+void Reduce_(void *sendrecvbuf,
+             size_t type_nbytes,
+             size_t count,
+             IEngine::ReduceFunction red,
+             mpi::DataType dtype,
+             mpi::OpType op,
+             int root,
+             IEngine::PreprocFunction prepare_fun = NULL,
+             void *prepare_arg = NULL);
+/*!
+ * \brief perform in-place ReduceScatter, on sendrecvbuf
+ *   this is an internal function used by rabit to be able to compile with MPI
+ *   do not use this function directly
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param type_nbytes the number of bytes the type has
+ * \param counts number of elements in the block of each node
+ * \param reducer reduce function
+ * \param dtype the data type
+ * \param op the reduce operator type
+ * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+ *                     will be called by the function before performing ReduceScatter, to initialize the data in sendrecvbuf_.
+ *                     If the result of ReduceScatter can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to pass into the lazy preprocessing function.
+ */
+void ReduceScatter_(void *sendrecvbuf,
+                    size_t type_nbytes,
+                    const std::vector<size_t> &counts,
+                    IEngine::ReduceFunction red,
+                    mpi::DataType dtype,
+                    mpi::OpType op,
+                    IEngine::PreprocFunction prepare_fun = NULL,
+                    void *prepare_arg = NULL);
+/*!
+ * \brief start in-place Allreduce on sendrecvbuf without waiting for it to finish,
+ *   the non-blocking collectives are done in the order they are issued, by a progress thread
+ *   that owns the engine until they finish, any other call to the engine waits for them first
+ *   this is an internal function used by rabit to be able to compile with MPI
+ *   do not use this function directly
+ * \param sendrecvbuf buffer for both sending and receiving data
+ * \param type_nbytes the number of bytes the type has
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \param dtype the data type
+ * \param op the reduce operator type
+ * \param prepare_func Lazy preprocessing function, it is called in the progress thread, see Allreduce_
+ * \param prepare_arg argument used to pass into the lazy preprocessing function.
+ * \return id of the request, used by TestRequest_ and WaitRequest_
+ */
+uint64_t IAllreduce_(void *sendrecvbuf,
+                     size_t type_nbytes,
+                     size_t count,
+                     IEngine::ReduceFunction red,
+                     mpi::DataType dtype,
+                     mpi::OpType op,
+                     IEngine::PreprocFunction prepare_fun = NULL,
+                     void *prepare_arg = NULL);
+/*!
+ * \brief start Broadcast without waiting for it to finish, see IAllreduce_
+ * \param sendrecv_data the pointer to send or recive buffer,
+ * \param size the size of the data
+ * \param root the root of process
+ * \return id of the request, used by TestRequest_ and WaitRequest_
+ */
+uint64_t IBroadcast_(void *sendrecv_data, size_t size, int root);
+/*!
+ * \brief check whether a non-blocking collective has finished
+ * \param id id of the request
+ */
+bool TestRequest_(uint64_t id);
+/*!
+ * \brief wait until a non-blocking collective finishes, and all the ones issued before it
+ * \param id id of the request
+ */
+void WaitRequest_(uint64_t id);
 
 /*!
  * \brief handle for customized reducer, used to handle customized reduce
@@ -6,6 +6,8 @@
  */
 #ifndef RABIT_RABIT_INL_H
 #define RABIT_RABIT_INL_H
+#include <cstring>
+#include <algorithm>
 // use engine for implementation
 #include "./io.h"
 #include "./utils.h"
@@ -113,7 +115,7 @@ inline std::string GetProcessorName(void) {
 }
 // broadcast data to all other nodes from root
 inline void Broadcast(void *sendrecv_data, size_t size, int root) {
-  engine::GetEngine()->Broadcast(sendrecv_data, size, root);
+  engine::GetIdleEngine()->Broadcast(sendrecv_data, size, root);
 }
 template<typename DType>
 inline void Broadcast(std::vector<DType> *sendrecv_data, int root) {
@@ -157,6 +159,84 @@ inline void Allreduce(DType *sendrecvbuf, size_t count, std::function<void()> pr
                      engine::mpi::GetType<DType>(), OP::kType, InvokeLambda_, &prepare_fun);
 }
 #endif // C++11
+// start inplace Allreduce in background
+template<typename OP, typename DType>
+inline Request IAllreduce(DType *sendrecvbuf, size_t count,
+                          void (*prepare_fun)(void *arg),
+                          void *prepare_arg) {
+  return Request(engine::IAllreduce_(sendrecvbuf, sizeof(DType), count, op::Reducer<OP,DType>,
+                                     engine::mpi::GetType<DType>(), OP::kType,
+                                     prepare_fun, prepare_arg));
+}
+// start Broadcast in background
+inline Request IBroadcast(void *sendrecv_data, size_t size, int root) {
+  return Request(engine::IBroadcast_(sendrecv_data, size, root));
+}
+inline bool Request::Test(void) const {
+  return id_ == 0 || engine::TestRequest_(id_);
+}
+inline void Request::Wait(void) const {
+  if (id_ != 0) engine::WaitRequest_(id_);
+}
+// perform inplace sparse Allreduce
+template<typename OP, typename DType>
+inline void SparseAllreduce(DType *sendrecvbuf, size_t count,
+                            void (*prepare_fun)(void *arg),
+                            void *prepare_arg) {
+  utils::Check(OP::kType == engine::mpi::kSum || OP::kType == engine::mpi::kBitwiseOR,
+               "SparseAllreduce only supports reducers with zero as identity");
+  engine::SparseAllreduce_(sendrecvbuf, sizeof(DType), count, op::Reducer<OP,DType>,
+                           engine::mpi::GetType<DType>(), OP::kType, prepare_fun, prepare_arg);
+}
+// perform inplace Reduce
+template<typename OP, typename DType>
+inline void Reduce(DType *sendrecvbuf, size_t count, int root,
+                   void (*prepare_fun)(void *arg),
+                   void *prepare_arg) {
+  engine::Reduce_(sendrecvbuf, sizeof(DType), count, op::Reducer<OP,DType>,
+                  engine::mpi::GetType<DType>(), OP::kType, root, prepare_fun, prepare_arg);
+}
+// perform inplace ReduceScatter
+template<typename OP, typename DType>
+inline void ReduceScatter(DType *sendrecvbuf, const std::vector<size_t> &counts,
+                          void (*prepare_fun)(void *arg),
+                          void *prepare_arg) {
+  engine::ReduceScatter_(sendrecvbuf, sizeof(DType), counts, op::Reducer<OP,DType>,
+                         engine::mpi::GetType<DType>(), OP::kType, prepare_fun, prepare_arg);
+}
+// perform inplace Allgather
+template<typename DType>
+inline void Allgather(DType *sendrecvbuf, size_t count) {
+  engine::GetIdleEngine()->Allgather(sendrecvbuf, count * sizeof(DType));
+}
+template<typename DType>
+inline void Allgatherv(DType *sendrecvbuf, const std::vector<size_t> &counts) {
+  std::vector<size_t> sizes(counts.size());
+  for (size_t i = 0; i < counts.size(); ++i) {
+    sizes[i] = counts[i] * sizeof(DType);
+  }
+  engine::GetIdleEngine()->Allgatherv(sendrecvbuf, sizes);
+}
+template<typename DType>
+inline void Allgatherv(std::vector<DType> *sendrecv_data,
+                       std::vector<size_t> *out_counts) {
+  const int nproc = GetWorldSize(), rank = GetRank();
+  std::vector<size_t> counts(nproc, 0);
+  counts[rank] = sendrecv_data->size();
+  Allgather(&counts[0], 1);
+  size_t begin = 0, total = 0;
+  for (int i = 0; i < nproc; ++i) {
+    if (i == rank) begin = total;
+    total += counts[i];
+  }
+  if (total != 0) {
+    std::vector<DType> temp(total);
+    std::copy(sendrecv_data->begin(), sendrecv_data->end(), temp.begin() + begin);
+    Allgatherv(&temp[0], counts);
+    sendrecv_data->swap(temp);
+  }
+  if (out_counts != NULL) out_counts->swap(counts);
+}
 
 // print message to the tracker
 inline void TrackerPrint(const std::string &msg) {
@@ -176,16 +256,16 @@ inline void TrackerPrintf(const char *fmt, ...) {
 // load latest check point
 inline int LoadCheckPoint(ISerializable *global_model,
                           ISerializable *local_model) {
-  return engine::GetEngine()->LoadCheckPoint(global_model, local_model);
+  return engine::GetIdleEngine()->LoadCheckPoint(global_model, local_model);
 }
 // checkpoint the model, meaning we finished a stage of execution
 inline void CheckPoint(const ISerializable *global_model,
                        const ISerializable *local_model) {
-  engine::GetEngine()->CheckPoint(global_model, local_model);
+  engine::GetIdleEngine()->CheckPoint(global_model, local_model);
 }
 // lazy checkpoint the model, only remember the pointer to global_model
 inline void LazyCheckPoint(const ISerializable *global_model) {
-  engine::GetEngine()->LazyCheckPoint(global_model);
+  engine::GetIdleEngine()->LazyCheckPoint(global_model);
 }
 // return the version number of currently stored model
 inline int VersionNumber(void) {
@@ -293,6 +373,157 @@ inline void SerializeReducer<DType>::Allreduce(DType *sendrecvobj,
   }
 }
 
+inline AllreduceBatch::AllreduceBatch(void)
+    : nelem_(0), elem_nbytes_(0), prepare_fun_(NULL), prepare_arg_(NULL) {
+  // the size of packed element is decided in Run
+  handle_.Init(Reduce_, 0);
+}
+template<typename OP, typename DType>
+inline void AllreduceBatch::Add(DType *sendrecvbuf, size_t count) {
+  Entry e;
+  e.ptr = sendrecvbuf; e.count = count; e.type_nbytes = sizeof(DType);
+  e.slot_count = 0; e.offset = 0;
+  e.reducer = op::Reducer<OP, DType>;
+  e.dtype = engine::mpi::GetType<DType>(); e.op = OP::kType;
+  entries_.push_back(e);
+}
+template<typename OP>
+inline engine::IEngine::ReduceFunction *
+AllreduceBatch::IntReducer_(int dtype, size_t *type_nbytes) {
+  using namespace engine::mpi;
+  switch (dtype) {
+    case kChar: *type_nbytes = sizeof(char); return op::Reducer<OP, char>;
+    case kUChar: *type_nbytes = sizeof(unsigned char); return op::Reducer<OP, unsigned char>;
+    case kInt: *type_nbytes = sizeof(int); return op::Reducer<OP, int>;
+    case kUInt: *type_nbytes = sizeof(unsigned); return op::Reducer<OP, unsigned>;
+    case kLong: *type_nbytes = sizeof(long); return op::Reducer<OP, long>;  // NOLINT(*)
+    case kULong: *type_nbytes = sizeof(unsigned long); return op::Reducer<OP, unsigned long>;  // NOLINT(*)
+    default: utils::Error("AllreduceBatch: invalid data type"); return NULL;
+  }
+}
+template<typename OP>
+inline engine::IEngine::ReduceFunction *
+AllreduceBatch::NumReducer_(int dtype, size_t *type_nbytes) {
+  using namespace engine::mpi;
+  switch (dtype) {
+    case kFloat: *type_nbytes = sizeof(float); return op::Reducer<OP, float>;
+    case kDouble: *type_nbytes = sizeof(double); return op::Reducer<OP, double>;
+    default: return IntReducer_<OP>(dtype, type_nbytes);
+  }
+}
+inline void AllreduceBatch::Reduce_(const void *src_, void *dst_, int len,
+                                    const MPI::Datatype &dtype) {
+  const size_t elem_nbytes = engine::ReduceHandle::TypeSize(dtype);
+  const char *src = static_cast<const char*>(src_);
+  char *dst = static_cast<char*>(dst_);
+  for (int i = 0; i < len; ++i) {
+    // the header is the same in all the nodes, it is kept in dst by the reduction
+    const uint64_t *head = reinterpret_cast<const uint64_t*>(dst);
+    size_t offset = (head[0] + 1) * sizeof(uint64_t);
+    for (uint64_t j = 1; j <= head[0]; ++j) {
+      const int slot_count = static_cast<int>(head[j] >> 16UL);
+      size_t type_nbytes = 0;
+      engine::IEngine::ReduceFunction *reducer;
+      switch (static_cast<int>((head[j] >> 8UL) & 0xffUL)) {
+        case engine::mpi::kMax: reducer = NumReducer_<op::Max>(head[j] & 0xffUL, &type_nbytes); break;
+        case engine::mpi::kMin: reducer = NumReducer_<op::Min>(head[j] & 0xffUL, &type_nbytes); break;
+        case engine::mpi::kSum: reducer = NumReducer_<op::Sum>(head[j] & 0xffUL, &type_nbytes); break;
+        default: reducer = IntReducer_<op::BitOR>(head[j] & 0xffUL, &type_nbytes);
+      }
+      reducer(src + offset, dst + offset, slot_count, dtype);
+      offset += (slot_count * type_nbytes + 7) / 8 * 8;
+    }
+    src += elem_nbytes; dst += elem_nbytes;
+  }
+}
+inline void AllreduceBatch::Prepare_(void *arg) {
+  AllreduceBatch *b = static_cast<AllreduceBatch*>(arg);
+  if (b->prepare_fun_ != NULL) b->prepare_fun_(b->prepare_arg_);
+  char *packed = reinterpret_cast<char*>(BeginPtr(b->packed_));
+  // the padding is reduced together with the data, keep it zero
+  std::fill(b->packed_.begin(), b->packed_.end(), 0);
+  // only the batch of mixed types has the header before the first slot
+  if (b->entries_[0].offset != 0) {
+    for (size_t i = 0; i < b->nelem_; ++i) {
+      uint64_t *head = reinterpret_cast<uint64_t*>(packed + i * b->elem_nbytes_);
+      head[0] = b->entries_.size();
+      for (size_t j = 0; j < b->entries_.size(); ++j) {
+        const Entry &e = b->entries_[j];
+        head[j + 1] = static_cast<uint64_t>(e.dtype) | (static_cast<uint64_t>(e.op) << 8UL) |
+            (static_cast<uint64_t>(e.slot_count) << 16UL);
+      }
+    }
+  }
+  for (size_t j = 0; j < b->entries_.size(); ++j) {
+    const Entry &e = b->entries_[j];
+    for (size_t i = 0, begin = 0; begin < e.count; ++i, begin += e.slot_count) {
+      const size_t n = std::min(e.slot_count, e.count - begin);
+      std::memcpy(packed + i * b->elem_nbytes_ + e.offset,
+                  static_cast<char*>(e.ptr) + begin * e.type_nbytes, n * e.type_nbytes);
+    }
+  }
+}
+inline void AllreduceBatch::Run(void (*prepare_fun)(void *arg),
+                                void *prepare_arg) {
+  if (entries_.size() == 0) {
+    if (prepare_fun != NULL) prepare_fun(prepare_arg);
+    return;
+  }
+  bool same_type = true;
+  size_t total_count = 0, total_nbytes = 0, max_count = 0;
+  for (size_t j = 0; j < entries_.size(); ++j) {
+    const Entry &e = entries_[j];
+    same_type = same_type && e.dtype == entries_[0].dtype && e.op == entries_[0].op;
+    total_count += e.count;
+    total_nbytes += e.count * e.type_nbytes;
+    max_count = std::max(max_count, e.count);
+  }
+  if (same_type) {
+    // the buffers are simply concatenated, and reduced as one array of the type
+    nelem_ = 1; elem_nbytes_ = 0;
+    for (size_t j = 0; j < entries_.size(); ++j) {
+      entries_[j].slot_count = entries_[j].count;
+      entries_[j].offset = elem_nbytes_;
+      elem_nbytes_ += entries_[j].count * entries_[j].type_nbytes;
+    }
+  } else {
+    // each packed element takes a slice of every buffer, so that large batches
+    // are still cut into many elements and can take the ring based methods,
+    // the header of each element tells the reducer how to reduce the slices
+    const size_t kElemBytes = 4096;
+    nelem_ = std::max(std::min(total_nbytes / kElemBytes, max_count), static_cast<size_t>(1));
+    elem_nbytes_ = (entries_.size() + 1) * sizeof(uint64_t);
+    for (size_t j = 0; j < entries_.size(); ++j) {
+      Entry &e = entries_[j];
+      e.slot_count = (e.count + nelem_ - 1) / nelem_;
+      e.offset = elem_nbytes_;
+      // keep each slot 64 bit aligned
+      elem_nbytes_ += (e.slot_count * e.type_nbytes + 7) / 8 * 8;
+    }
+  }
+  packed_.resize((nelem_ * elem_nbytes_ + 7) / 8);
+  prepare_fun_ = prepare_fun; prepare_arg_ = prepare_arg;
+  if (same_type) {
+    engine::Allreduce_(BeginPtr(packed_), entries_[0].type_nbytes, total_count,
+                       entries_[0].reducer, entries_[0].dtype, entries_[0].op,
+                       Prepare_, this);
+  } else {
+    handle_.Allreduce(BeginPtr(packed_), elem_nbytes_, nelem_, Prepare_, this);
+  }
+  // scatter the result back to the buffers
+  const char *packed = reinterpret_cast<const char*>(BeginPtr(packed_));
+  for (size_t j = 0; j < entries_.size(); ++j) {
+    const Entry &e = entries_[j];
+    for (size_t i = 0, begin = 0; begin < e.count; ++i, begin += e.slot_count) {
+      const size_t n = std::min(e.slot_count, e.count - begin);
+      std::memcpy(static_cast<char*>(e.ptr) + begin * e.type_nbytes,
+                  packed + i * elem_nbytes_ + e.offset, n * e.type_nbytes);
+    }
+  }
+  entries_.clear();
+  prepare_fun_ = NULL; prepare_arg_ = NULL;
+}
+
 #if __cplusplus >= 201103L
 template<typename DType, void (*freduce)(DType &dst, const DType &src)>
 inline void Reducer<DType, freduce>::Allreduce(DType *sendrecvbuf, size_t count,
@@ -305,6 +536,9 @@ inline void SerializeReducer<DType>::Allreduce(DType *sendrecvobj,
                                                std::function<void()> prepare_fun) {
   this->Allreduce(sendrecvobj, max_nbytes, count, InvokeLambda_, &prepare_fun);
 }
+inline void AllreduceBatch::Run(std::function<void()> prepare_fun) {
+  this->Run(InvokeLambda_, &prepare_fun);
+}
 #endif
 }  // namespace rabit
 #endif
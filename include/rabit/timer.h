@@ -23,7 +23,7 @@ namespace utils {
 #ifdef __APPLE__
     /* OS X replacement coded by Jens Gustedt,
        http://stackoverflow.com/questions/5167269/clock-gettime-alternative-in-mac-os-x  */
-    struct timespec clock_gettime(void) {
+    inline struct timespec clock_gettime(void) {
         if (!orwl_timestart) {
             mach_timebase_info_data_t tb = { 0 };
             mach_timebase_info(&tb);
@@ -9,6 +9,7 @@
 #define RABIT_LEARN_LBFGS_H_
 #include <cmath>
 #include <rabit.h>
+#include "../utils/quantize.h"
 
 namespace rabit {
 /*! \brief namespace of solver for general problems */
@@ -64,6 +65,7 @@ class LBFGSSolver {
     max_lbfgs_iter = 500;
     lbfgs_stop_tol = 1e-5f;
     silent = 0;
+    sparse_grad = 0;
   }
   virtual ~LBFGSSolver(void) {}
   /*!
@@ -96,9 +98,13 @@ class LBFGSSolver {
     if (!strcmp("min_lbfgs_iter", name)) {
       min_lbfgs_iter = atoi(val);
     }
+    if (!strcmp("sparse_grad", name)) {
+      sparse_grad = atoi(val);
+    }
     if (!strcmp("linesearch_c1", name)) {
       linesearch_c1 = static_cast<float>(atof(val));
     }
+    quantizer.SetParam(name, val);
   }
   /*!
    * \brief set objective function to optimize
@@ -116,7 +122,9 @@ class LBFGSSolver {
   virtual void Init(void) {
     utils::Check(gstate.obj != NULL,
                  "LBFGSSolver.Init must SetObjFunction first");
-    int version = rabit::LoadCheckPoint(&gstate, &hist);
+    local.hist = &hist;
+    local.quantizer = &quantizer;
+    int version = rabit::LoadCheckPoint(&gstate, &local);
     if (version == 0) {
       gstate.num_dim = gstate.obj->InitNumDim();
     } else {
@@ -167,11 +175,30 @@ class LBFGSSolver {
     bool stop = false;
     GlobalState &g = gstate;
     g.obj->CalcGrad(g.grad, g.weight, g.num_dim);
-    rabit::Allreduce<rabit::op::Sum>(g.grad, g.num_dim);
+    if (quantizer.enabled()) {
+      // quantized or top-k gradient, the error is fed back in next iteration,
+      // the result is summed in float, so the curvature pairs do not take the error of reduction
+      quantizer.Allreduce(g.grad, g.num_dim, kGradKey);
+    } else {
+      this->AllreduceGrad(g.grad);
+    }
     // find change direction
     double vdot = FindChangeDirection(g.tempw, g.grad, g.weight);
     // line-search, g.grad is now new weight
     int iter = BacktrackLineSearch(g.grad, g.tempw, g.weight, vdot);
+    if (iter >= max_linesearch_iter && quantizer.enabled()) {
+      // the quantized gradient does not give a descent direction,
+      // take the step along the exact gradient instead, which leaves no error to feed back
+      if (silent == 0 && rabit::GetRank() == 0) {
+        rabit::TrackerPrintf("[%d] L-BFGS: linesearch fails with quantized gradient, "
+                             "retry with exact gradient\n", gstate.num_iteration);
+      }
+      quantizer.ClearResidual(kGradKey);
+      g.obj->CalcGrad(g.grad, g.weight, g.num_dim);
+      this->AllreduceGrad(g.grad);
+      vdot = SteepestDirection(g.tempw, g.grad, g.weight);
+      iter = BacktrackLineSearch(g.grad, g.tempw, g.weight, vdot, true);
+    }
     utils::Check(iter < max_linesearch_iter, "line search failed");
     // swap new weight 
     std::swap(g.weight, g.grad);
@@ -189,7 +216,7 @@ class LBFGSSolver {
            gstate.old_objval - gstate.new_objval);
     }
     gstate.old_objval = gstate.new_objval;
-    rabit::CheckPoint(&gstate, &hist);
+    rabit::CheckPoint(&gstate, &local);
     return stop;
   }
   /*! \brief run optimization */
@@ -209,6 +236,29 @@ class LBFGSSolver {
     }
   }
  protected:
+  // key of the residual of gradient in quantizer
+  static const int kGradKey = 0;
+  // sum up the gradient of all nodes without quantization
+  inline void AllreduceGrad(DType *grad) {
+    if (sparse_grad != 0) {
+      // gradient of each node only touches the features in its data
+      rabit::SparseAllreduce<rabit::op::Sum>(grad, gstate.num_dim);
+    } else {
+      rabit::Allreduce<rabit::op::Sum>(grad, gstate.num_dim);
+    }
+  }
+  // use the steepest direction of given gradient after FindChangeDirection is called,
+  // the gradient replaces the one kept in history by FindChangeDirection
+  // return dot(dir, l1grad)
+  inline double SteepestDirection(DType *dir,
+                                  const DType *grad,
+                                  const DType *weight) {
+    const size_t m = gstate.size_memory;
+    const size_t n = hist.num_useful();
+    SetL1Dir(dir, grad, weight, gstate.num_dim);
+    memcpy(hist[m + n - 1], grad + range_begin_, (range_end_ - range_begin_) * sizeof(DType));
+    return -Dot(dir, dir, gstate.num_dim);
+  }
   // find the delta value, given gradient
   // return dot(dir, l1grad)
   virtual double FindChangeDirection(DType *dir,
@@ -291,9 +341,11 @@ class LBFGSSolver {
       }
       FixDirL1Sign(dirsub, hist[2 * m], nsub);
       vdot = -Dot(dirsub, hist[2 * m], nsub);
-      // allreduce to get full direction
-      rabit::Allreduce<rabit::op::Sum>(dir, num_dim);
-      rabit::Allreduce<rabit::op::Sum>(&vdot, 1);
+      // allreduce to get full direction, together with the dot product
+      rabit::AllreduceBatch batch;
+      batch.Add<rabit::op::Sum>(dir, num_dim);
+      batch.Add<rabit::op::Sum>(&vdot, 1);
+      batch.Run();
     } else {     
       SetL1Dir(dir, grad, weight, num_dim);
       vdot = -Dot(dir, dir, num_dim);
@@ -310,18 +362,20 @@ class LBFGSSolver {
     return vdot;
   }
   // line search for given direction
+  // steepest gives whether dir is the steepest direction, which is not scaled by history
   // return whether there is a descent
   inline int BacktrackLineSearch(DType *new_weight,
                                  const DType *dir,
                                  const DType *weight,
-                                 double dot_dir_l1grad) {
+                                 double dot_dir_l1grad,
+                                 bool steepest = false) {
     utils::Assert(dot_dir_l1grad < 0.0f,
                   "gradient error, dotv=%g", dot_dir_l1grad);
     double alpha = 1.0;
     double backoff = linesearch_backoff;
     // unit descent direction in first iter
-    if (gstate.num_iteration == 0) {
-      utils::Assert(hist.num_useful() == 1, "hist.nuseful");
+    if (gstate.num_iteration == 0 || steepest) {
+      utils::Assert(gstate.num_iteration != 0 || hist.num_useful() == 1, "hist.nuseful");
       alpha = 1.0f / std::sqrt(-dot_dir_l1grad);
       backoff = 0.1f;
     }
@@ -630,14 +684,32 @@ class LBFGSSolver {
     // data pointer
     DType *dptr_;
   };
+  /*! \brief local state of each node, the history and residual of quantized gradient */
+  struct LocalState : public rabit::ISerializable {
+    HistoryArray *hist;
+    utils::GradQuantizer *quantizer;
+    virtual void Load(rabit::IStream &fi) {
+      hist->Load(fi);
+      quantizer->Load(fi);
+    }
+    virtual void Save(rabit::IStream &fo) const {
+      hist->Save(fo);
+      quantizer->Save(fo);
+    }
+  };
   // data structure for LBFGS
   GlobalState gstate;
   HistoryArray hist;
+  LocalState local;
+  // allreduce of gradient in quantized format
+  utils::GradQuantizer quantizer;
   // silent
   int silent;
   // the subrange of current node
   size_t range_begin_;
   size_t range_end_;
+  // whether the gradient is sparse, use sparse allreduce to sum it up
+  int sparse_grad;
   // L1 regularization co-efficient
   float reg_L1;
   // c1 ratio for line search
@@ -11,6 +11,11 @@
 #include <map>
 #include <cstdlib>
 #include <cstring>
+#include <sstream>
+#include <limits>
+#include "../include/rabit/rabit-inl.h"
+#include "../include/rabit/timer.h"
+#include "./codec.h"
 #include "./allreduce_base.h"
 
 namespace rabit {
@@ -22,13 +27,37 @@ AllreduceBase::AllreduceBase(void) {
   host_uri = "";
   slave_port = 9010;
   nport_trial = 1000;
+  unix_dir = "/tmp";
   rank = 0;
   world_size = -1;
   hadoop_mode = 0;
   version_number = 0;
   task_id = "NULL";
+  zone = "NULL";
   err_link = NULL;
+  ring_prev = ring_next = NULL;
+  num_dtree = 0;
+  hier_parent_index = -1;
   this->SetParam("rabit_reduce_buffer", "256MB");
+  this->SetParam("rabit_ring_threshold", "1MB");
+  this->SetParam("rabit_halving_threshold", "10KB");
+  this->SetParam("rabit_small_threshold", "4KB");
+  this->SetParam("rabit_bcast_segment", "256KB");
+  this->SetParam("rabit_bcast_method", "auto");
+  this->SetParam("rabit_sparse_segment", "65536");
+  this->SetParam("rabit_double_tree", "0");
+  this->SetParam("rabit_hierarchical", "0");
+  this->SetParam("rabit_shm_buffer", "4MB");
+  this->SetParam("rabit_tree_arity", "2");
+  this->SetParam("rabit_wire_dtype", "fp32");
+  this->SetParam("rabit_compress", "0");
+  this->SetParam("rabit_compress_min", "64KB");
+  this->SetParam("rabit_io_uring", "0");
+  this->SetParam("rabit_busy_poll_us", "0");
+  this->SetParam("rabit_autotune", "0");
+  this->SetParam("rabit_autotune_file", "NULL");
+  this->SetParam("rabit_autotune_max", "4MB");
+  this->SetParam("rabit_autotune_dump", "0");
 }
 
 // initialization function
@@ -68,6 +97,11 @@ void AllreduceBase::Init(void) {
     if (num_task != NULL) {
       this->SetParam("rabit_world_size", num_task);
     }
+    // rack or zone of the node, the tracker gives adjacent ranks to nodes in the same zone
+    const char *zone = getenv("RABIT_ZONE");
+    if (zone != NULL) {
+      this->SetParam("rabit_zone", zone);
+    }
   }
   // clear the setting before start reconnection
   this->rank = -1;
@@ -78,14 +112,31 @@ void AllreduceBase::Init(void) {
   this->host_uri = utils::SockAddr::GetHostName();
   // get information from tracker
   this->ReConnectLinks();
+  // fall back to waiting for the links by epoll or select if io_uring is not supported
+  if (use_uring != 0 && !uring.Init(256)) {
+    utils::Printf("[%d] io_uring is not supported, rabit_io_uring is ignored\n", rank);
+  }
+  if (autotune != 0) this->InitAutoTune();
 }
 
 void AllreduceBase::Shutdown(void) {
+  if (busy_poll.spin_us > 0) {
+    std::ostringstream os;
+    os << "[" << rank << "] busy poll: " << busy_poll.nspin << " waits done in spinning, "
+       << busy_poll.nblock << " blocked after spinning, "
+       << busy_poll.tspin << " sec spent in spinning\n";
+    this->TrackerPrint(os.str());
+  }
+  uring.Close();
   for (size_t i = 0; i < all_links.size(); ++i) {
     all_links[i].sock.Close();
   }
   all_links.clear();
   tree_links.plinks.clear();
+  hd_links.plinks.clear();
+  dtree_links[0].plinks.clear();
+  dtree_links[1].plinks.clear();
+  hier_links.plinks.clear();
 
   if (tracker_uri == "NULL") return;
   // notify tracker rank i have shutdown
@@ -103,6 +154,33 @@ void AllreduceBase::TrackerPrint(const std::string &msg) {
   tracker.SendStr(msg);
   tracker.Close();
 }
+/*!
+ * \brief parse a memory size in format of {integer}{unit}, such as 128M, 1GB
+ * \param name name of the parameter, used in error message
+ * \param val the value to be parsed
+ * \return the size in bytes
+ */
+inline size_t ParseUnit(const char *name, const char *val) {
+  char unit;
+  unsigned long amount;  // NOLINT(*)
+  int n = sscanf(val, "%lu%c", &amount, &unit);
+  size_t amt = amount;
+  if (n == 2) {
+    switch (unit) {
+      case 'B': return amt;
+      case 'K': return amt << 10UL;
+      case 'M': return amt << 20UL;
+      case 'G': return amt << 30UL;
+      default: utils::Error("invalid format for %s", name); return 0;
+    }
+  } else if (n == 1) {
+    return amt;
+  } else {
+    utils::Error("invalid format for %s,"                               \
+                 "shhould be {integer}{unit}, unit can be {B, KB, MB, GB}", name);
+    return 0;
+  }
+}
 /*!
  * \brief set parameters to the engine 
  * \param name parameter name
@@ -112,22 +190,82 @@ void AllreduceBase::SetParam(const char *name, const char *val) {
   if (!strcmp(name, "rabit_tracker_uri")) tracker_uri = val;
   if (!strcmp(name, "rabit_tracker_port")) tracker_port = atoi(val);
   if (!strcmp(name, "rabit_task_id")) task_id = val;
+  if (!strcmp(name, "rabit_zone")) zone = val;
+  if (!strcmp(name, "rabit_unix_dir")) unix_dir = val;
   if (!strcmp(name, "rabit_world_size")) world_size = atoi(val);
   if (!strcmp(name, "rabit_hadoop_mode")) hadoop_mode = atoi(val);
+  if (!strcmp(name, "rabit_double_tree")) use_double_tree = atoi(val);
+  if (!strcmp(name, "rabit_hierarchical")) use_hierarchical = atoi(val);
+  if (!strcmp(name, "rabit_autotune")) autotune = atoi(val);
+  if (!strcmp(name, "rabit_compress")) compress = atoi(val);
+  if (!strcmp(name, "rabit_autotune_file")) autotune_file = val;
+  if (!strcmp(name, "rabit_autotune_dump")) autotune_dump = atoi(val);
+  if (!strcmp(name, "rabit_autotune_max")) {
+    autotune_max = ParseUnit(name, val);
+    utils::Check(autotune_max >= 8, "rabit_autotune_max must be at least 8 bytes");
+  }
+  if (!strcmp(name, "rabit_tree_arity")) {
+    tree_arity = atoi(val);
+    utils::Check(tree_arity >= 2, "rabit_tree_arity must be at least 2");
+  }
   if (!strcmp(name, "rabit_reduce_buffer")) {
-    char unit;
-    uint64_t amount;
-    if (sscanf(val, "%lu%c", &amount, &unit) == 2) {
-      switch (unit) {
-        case 'B': reduce_buffer_size = (amount + 7)/ 8; break;
-        case 'K': reduce_buffer_size = amount << 7UL; break;
-        case 'M': reduce_buffer_size = amount << 17UL; break;
-        case 'G': reduce_buffer_size = amount << 27UL; break;
-        default: utils::Error("invalid format for reduce buffer");
-      }
+    reduce_buffer_size = (ParseUnit(name, val) + 7) >> 3;
+  }
+  if (!strcmp(name, "rabit_shm_buffer")) {
+    shm_buffer_size = ParseUnit(name, val);
+  }
+  if (!strcmp(name, "rabit_ring_threshold")) {
+    ring_threshold = ParseUnit(name, val);
+  }
+  if (!strcmp(name, "rabit_halving_threshold")) {
+    halving_threshold = ParseUnit(name, val);
+  }
+  if (!strcmp(name, "rabit_small_threshold")) {
+    small_threshold = ParseUnit(name, val);
+  }
+  if (!strcmp(name, "rabit_busy_poll_us")) {
+    busy_poll.spin_us = atol(val);
+  }
+  if (!strcmp(name, "rabit_io_uring")) {
+    use_uring = atoi(val);
+  }
+  if (!strcmp(name, "rabit_compress_min")) {
+    compress_min = ParseUnit(name, val);
+  }
+  if (!strcmp(name, "rabit_bcast_segment")) {
+    bcast_segment = ParseUnit(name, val);
+    utils::Check(bcast_segment != 0, "rabit_bcast_segment must be positive");
+  }
+  if (!strcmp(name, "rabit_sparse_segment")) {
+    sparse_segment = static_cast<size_t>(atol(val));
+    // offsets in a segment are encoded as uint16_t
+    utils::Check(sparse_segment != 0 && sparse_segment <= 65536,
+                 "rabit_sparse_segment must be in [1, 65536]");
+  }
+  if (!strcmp(name, "rabit_wire_dtype")) {
+    if (!strcmp(val, "fp32")) {
+      wire_dtype = utils::kFP32;
+    } else if (!strcmp(val, "fp16")) {
+      wire_dtype = utils::kFP16;
+    } else if (!strcmp(val, "bf16")) {
+      wire_dtype = utils::kBF16;
+    } else {
+      utils::Error("invalid value %s for rabit_wire_dtype,"\
+                   "can be {fp32, fp16, bf16}", val);
+    }
+  }
+  if (!strcmp(name, "rabit_bcast_method")) {
+    if (!strcmp(val, "auto")) {
+      bcast_method = kBcastAuto;
+    } else if (!strcmp(val, "tree")) {
+      bcast_method = kBcastTree;
+    } else if (!strcmp(val, "chain")) {
+      bcast_method = kBcastChain;
+    } else if (!strcmp(val, "scatter")) {
+      bcast_method = kBcastScatter;
     } else {
-      utils::Error("invalid format for reduce_buffer,"\
-                   "shhould be {integer}{unit}, unit can be {B, KB, MB, GB}");
+      utils::Error("invalid value %s for rabit_bcast_method,"\
+                   "can be {auto, tree, chain, scatter}", val);
     }
   }
 }
@@ -153,7 +291,16 @@ utils::TCPSocket AllreduceBase::ConnectTracker(void) const {
                 "ReConnectLink failure 3");
   Assert(tracker.SendAll(&world_size, sizeof(world_size)) == sizeof(world_size),
          "ReConnectLink failure 3");
+  Assert(tracker.SendAll(&tree_arity, sizeof(tree_arity)) == sizeof(tree_arity),
+         "ReConnectLink failure 3");
+  // links of double binary tree and hierarchical allreduce are only given when they can be used
+  int need_links[2];
+  need_links[0] = this->NeedDoubleTree() ? 1 : 0;
+  need_links[1] = this->NeedHierarchical() ? 1 : 0;
+  Assert(tracker.SendAll(need_links, sizeof(need_links)) == sizeof(need_links),
+         "ReConnectLink failure 3");
   tracker.SendStr(task_id);
+  tracker.SendStr(zone);
   return tracker;
 }
 /*!
@@ -167,6 +314,9 @@ void AllreduceBase::ReConnectLinks(const char *cmd) {
   }
   utils::TCPSocket tracker = this->ConnectTracker();
   tracker.SendStr(std::string(cmd));
+  // the links can be closed and connected again, with descriptors reused
+  poller.Reset();
+  poller.SetBusyPoll(&busy_poll);
 
   // the rank of previous link, next link in ring
   int prev_rank, next_rank;
@@ -196,15 +346,82 @@ void AllreduceBase::ReConnectLinks(const char *cmd) {
          "ReConnectLink failure 4");
   Assert(tracker.RecvAll(&next_rank, sizeof(next_rank)) == sizeof(next_rank),
          "ReConnectLink failure 4");
+  // the rank of peers in recursive halving and doubling
+  int num_hd_peers;
+  Assert(tracker.RecvAll(&num_hd_peers, sizeof(num_hd_peers)) == \
+         sizeof(num_hd_peers), "ReConnectLink failure 4");
+  std::vector<int> hd_peers(num_hd_peers);
+  for (int i = 0; i < num_hd_peers; ++i) {
+    Assert(tracker.RecvAll(&hd_peers[i], sizeof(hd_peers[i])) == sizeof(hd_peers[i]),
+           "ReConnectLink failure 4");
+  }
+  // the parent of every node in the tree
+  tree_parents.resize(world_size);
+  for (int i = 0; i < world_size; ++i) {
+    Assert(tracker.RecvAll(&tree_parents[i], sizeof(tree_parents[i])) == sizeof(tree_parents[i]),
+           "ReConnectLink failure 4");
+  }
+  // parent and neighbors in the two trees of double binary tree
+  int dtree_parent[2];
+  std::vector<int> dtree_neighbors[2];
+  Assert(tracker.RecvAll(&num_dtree, sizeof(num_dtree)) == sizeof(num_dtree),
+         "ReConnectLink failure 4");
+  Assert(num_dtree == 0 || num_dtree == 2, "ReConnectLink: invalid number of double tree");
+  for (int k = 0; k < num_dtree; ++k) {
+    int num_dtree_neighbors;
+    Assert(tracker.RecvAll(&dtree_parent[k], sizeof(dtree_parent[k])) == \
+           sizeof(dtree_parent[k]), "ReConnectLink failure 4");
+    Assert(tracker.RecvAll(&num_dtree_neighbors, sizeof(num_dtree_neighbors)) == \
+           sizeof(num_dtree_neighbors), "ReConnectLink failure 4");
+    dtree_neighbors[k].resize(num_dtree_neighbors);
+    for (int i = 0; i < num_dtree_neighbors; ++i) {
+      Assert(tracker.RecvAll(&dtree_neighbors[k][i], sizeof(dtree_neighbors[k][i])) == \
+             sizeof(dtree_neighbors[k][i]), "ReConnectLink failure 4");
+    }
+  }
+  // parent and neighbors in the tree of hierarchical allreduce
+  int hier_parent, num_hier_neighbors;
+  Assert(tracker.RecvAll(&hier_parent, sizeof(hier_parent)) == sizeof(hier_parent),
+         "ReConnectLink failure 4");
+  Assert(tracker.RecvAll(&num_hier_neighbors, sizeof(num_hier_neighbors)) == \
+         sizeof(num_hier_neighbors), "ReConnectLink failure 4");
+  std::vector<int> hier_neighbors(num_hier_neighbors);
+  for (int i = 0; i < num_hier_neighbors; ++i) {
+    Assert(tracker.RecvAll(&hier_neighbors[i], sizeof(hier_neighbors[i])) == \
+           sizeof(hier_neighbors[i]), "ReConnectLink failure 4");
+  }
+  // neighbors in the same host
+  int num_local_peers;
+  Assert(tracker.RecvAll(&num_local_peers, sizeof(num_local_peers)) == \
+         sizeof(num_local_peers), "ReConnectLink failure 4");
+  std::vector<int> local_peers(num_local_peers);
+  for (int i = 0; i < num_local_peers; ++i) {
+    Assert(tracker.RecvAll(&local_peers[i], sizeof(local_peers[i])) == \
+           sizeof(local_peers[i]), "ReConnectLink failure 4");
+  }
   // create listening socket
   utils::TCPSocket sock_listen;
   sock_listen.Create();
   int port = sock_listen.TryBindHost(slave_port, slave_port + nport_trial);
   utils::Check(port != -1, "ReConnectLink fail to bind the ports specified");
   sock_listen.Listen();
+  // nodes in the same host connect to the unix domain socket if it is available
+  utils::TCPSocket sock_unix;
+  std::string unix_path;
+  if (unix_dir != "NULL") {
+    sock_unix.Create(AF_UNIX);
+    unix_path = sock_unix.TryBindUnix(unix_dir, port);
+    if (unix_path.length() != 0) {
+      sock_unix.Listen();
+    } else {
+      sock_unix.Close();
+    }
+  }
 
   // get number of to connect and number of to accept nodes from tracker
   int num_conn, num_accept, num_error = 1;
+  // ranks of nodes linked by new connections
+  std::vector<int> new_ranks;
   do {
     // send over good links
     std::vector<int> good_link;
@@ -230,15 +447,25 @@ void AllreduceBase::ReConnectLinks(const char *cmd) {
     for (int i = 0; i < num_conn; ++i) {
       LinkRecord r;
       int hport, hrank;
-      std::string hname;
+      std::string hname, hpath;
       tracker.RecvStr(&hname);
       Assert(tracker.RecvAll(&hport, sizeof(hport)) == sizeof(hport),
              "ReConnectLink failure 9");
       Assert(tracker.RecvAll(&hrank, sizeof(hrank)) == sizeof(hrank),
              "ReConnectLink failure 10");
-      r.sock.Create();
-      if (!r.sock.Connect(utils::SockAddr(hname.c_str(), hport))) {
-        num_error += 1; r.sock.Close(); continue;
+      // path of unix domain socket, only given when the node is in the same host
+      tracker.RecvStr(&hpath);
+      bool connected = false;
+      if (hpath.length() != 0) {
+        r.sock.Create(AF_UNIX);
+        connected = r.sock.ConnectUnix(hpath);
+        if (!connected) r.sock.Close();
+      }
+      if (!connected) {
+        r.sock.Create();
+        if (!r.sock.Connect(utils::SockAddr(hname.c_str(), hport))) {
+          num_error += 1; r.sock.Close(); continue;
+        }
       }
       Assert(r.sock.SendAll(&rank, sizeof(rank)) == sizeof(rank),
              "ReConnectLink failure 12");
@@ -246,6 +473,7 @@ void AllreduceBase::ReConnectLinks(const char *cmd) {
              "ReConnectLink failure 13");
       utils::Check(hrank == r.rank,
                    "ReConnectLink failure, link rank inconsistent");
+      new_ranks.push_back(r.rank);
       bool match = false;
       for (size_t i = 0; i < all_links.size(); ++i) {
         if (all_links[i].rank == hrank) {
@@ -262,16 +490,35 @@ void AllreduceBase::ReConnectLinks(const char *cmd) {
   // send back socket listening port to tracker
   Assert(tracker.SendAll(&port, sizeof(port)) == sizeof(port),
          "ReConnectLink failure 14");
+  tracker.SendStr(unix_path);
+  tracker.RecvStr(&tracker_tune_table);
+  // the nodes whose tuning failed at start take the table when they recover
+  if (autotune != 0 && tracker_tune_table.length() != 0) {
+    tune_table.Load(tracker_tune_table, world_size);
+  }
   // close connection to tracker
   tracker.Close();
   // listen to incoming links
   for (int i = 0; i < num_accept; ++i) {
     LinkRecord r;
-    r.sock = sock_listen.Accept();
+    if (sock_unix.IsClosed()) {
+      r.sock = sock_listen.Accept();
+    } else {
+      utils::SelectHelper selecter;
+      selecter.WatchRead(sock_listen);
+      selecter.WatchRead(sock_unix);
+      selecter.Select();
+      if (selecter.CheckRead(static_cast<SOCKET>(sock_listen))) {
+        r.sock = sock_listen.Accept();
+      } else {
+        r.sock = sock_unix.Accept();
+      }
+    }
     Assert(r.sock.SendAll(&rank, sizeof(rank)) == sizeof(rank),
            "ReConnectLink failure 15");
     Assert(r.sock.RecvAll(&r.rank, sizeof(r.rank)) == sizeof(r.rank),
            "ReConnectLink failure 15");
+    new_ranks.push_back(r.rank);
     bool match = false;
     for (size_t i = 0; i < all_links.size(); ++i) {
       if (all_links[i].rank == r.rank) {
@@ -284,14 +531,22 @@ void AllreduceBase::ReConnectLinks(const char *cmd) {
   }
   // close listening sockets
   sock_listen.Close();
+  if (!sock_unix.IsClosed()) sock_unix.CloseUnix(unix_path);
+  this->InitShmLinks(new_ranks, local_peers);
   this->parent_index = -1;
   // setup tree links and ring structure
   tree_links.plinks.clear();
+  ring_prev = ring_next = NULL;
   for (size_t i = 0; i < all_links.size(); ++i) {
     utils::Assert(!all_links[i].sock.BadSocket(), "ReConnectLink: bad socket");
-    // set the socket to non-blocking mode, enable TCP keepalive
+    // set the socket to non-blocking mode, enable TCP keepalive,
+    // disable Nagle's algorithm so that small messages are not delayed,
+    // the TCP options do not apply to unix domain socket
     all_links[i].sock.SetNonBlock(true);
-    all_links[i].sock.SetKeepAlive(true);
+    if (!all_links[i].sock.IsUnix()) {
+      all_links[i].sock.SetKeepAlive(true);
+      all_links[i].sock.SetNoDelay(true);
+    }
     if (tree_neighbors.count(all_links[i].rank) != 0) {
       if (all_links[i].rank == parent_rank) {
         parent_index = static_cast<int>(tree_links.plinks.size());
@@ -307,6 +562,424 @@ void AllreduceBase::ReConnectLinks(const char *cmd) {
          "cannot find prev ring in the link");
   Assert(next_rank == -1 || ring_next != NULL,
          "cannot find next ring in the link");
+  // setup links of recursive halving and doubling, keep the order given by tracker
+  hd_links.plinks.clear();
+  for (size_t j = 0; j < hd_peers.size(); ++j) {
+    for (size_t i = 0; i < all_links.size(); ++i) {
+      if (all_links[i].rank == hd_peers[j]) {
+        hd_links.plinks.push_back(&all_links[i]); break;
+      }
+    }
+  }
+  Assert(hd_links.size() == hd_peers.size(),
+         "cannot find halving doubling peer in the link");
+  // setup links of double binary tree
+  for (int k = 0; k < 2; ++k) {
+    dtree_links[k].plinks.clear();
+    dtree_parent_index[k] = -1;
+  }
+  for (int k = 0; k < num_dtree; ++k) {
+    for (size_t j = 0; j < dtree_neighbors[k].size(); ++j) {
+      for (size_t i = 0; i < all_links.size(); ++i) {
+        if (all_links[i].rank == dtree_neighbors[k][j]) {
+          if (all_links[i].rank == dtree_parent[k]) {
+            dtree_parent_index[k] = static_cast<int>(dtree_links[k].plinks.size());
+          }
+          dtree_links[k].plinks.push_back(&all_links[i]); break;
+        }
+      }
+    }
+    Assert(dtree_links[k].size() == dtree_neighbors[k].size(),
+           "cannot find double tree neighbor in the link");
+    Assert(dtree_parent[k] == -1 || dtree_parent_index[k] != -1,
+           "cannot find double tree parent in the link");
+  }
+  // setup links of hierarchical allreduce
+  hier_links.plinks.clear();
+  hier_parent_index = -1;
+  for (size_t j = 0; j < hier_neighbors.size(); ++j) {
+    for (size_t i = 0; i < all_links.size(); ++i) {
+      if (all_links[i].rank == hier_neighbors[j]) {
+        if (all_links[i].rank == hier_parent) {
+          hier_parent_index = static_cast<int>(hier_links.plinks.size());
+        }
+        hier_links.plinks.push_back(&all_links[i]); break;
+      }
+    }
+  }
+  Assert(hier_links.size() == hier_neighbors.size(),
+         "cannot find hierarchical allreduce neighbor in the link");
+  Assert(hier_parent == -1 || hier_parent_index != -1,
+         "cannot find hierarchical allreduce parent in the link");
+  // the tracker numbers the nodes along the ring, ring allreduce relies on this
+  Assert(next_rank == -1 || next_rank == (rank + 1) % world_size,
+         "ReConnectLink: ring structure inconsistent with rank");
+}
+/*!
+ * \brief setup shared memory channel of new links to the nodes in the same host,
+ *  the data of these links goes through shared memory afterwards
+ * \param new_ranks ranks of nodes linked by new connections
+ * \param local_ranks ranks of the neighbors in the same host, given by tracker
+ */
+void AllreduceBase::InitShmLinks(const std::vector<int> &new_ranks,
+                                 const std::vector<int> &local_ranks) {
+  using utils::Assert;
+  std::vector<LinkRecord*> links;
+  for (size_t i = 0; i < all_links.size(); ++i) {
+    if (std::find(new_ranks.begin(), new_ranks.end(), all_links[i].rank) != new_ranks.end()) {
+      links.push_back(&all_links[i]);
+    }
+  }
+  // the new links are still in blocking mode, each step sends to all the links
+  // before receiving from any of them, so the nodes do not wait for each other in a cycle
+  std::vector<char> use_shm(links.size());
+  for (size_t i = 0; i < links.size(); ++i) {
+    char want = shm_buffer_size != 0 &&
+        std::find(local_ranks.begin(), local_ranks.end(), links[i]->rank) != local_ranks.end();
+    Assert(links[i]->sock.SendAll(&want, sizeof(want)) == sizeof(want),
+           "InitShmLinks failure 1");
+    use_shm[i] = want;
+  }
+  for (size_t i = 0; i < links.size(); ++i) {
+    char want;
+    Assert(links[i]->sock.RecvAll(&want, sizeof(want)) == sizeof(want),
+           "InitShmLinks failure 2");
+    use_shm[i] = use_shm[i] && want;
+  }
+  // the node with smaller rank creates the shared memory
+  std::vector<utils::ShmChannel*> channels(links.size(), NULL);
+  for (size_t i = 0; i < links.size(); ++i) {
+    if (!use_shm[i] || rank > links[i]->rank) continue;
+    std::ostringstream tag;
+    tag << rank << '.' << links[i]->rank;
+    channels[i] = utils::ShmChannel::Create(tag.str(), shm_buffer_size);
+    char ok = channels[i] != NULL;
+    Assert(links[i]->sock.SendAll(&ok, sizeof(ok)) == sizeof(ok),
+           "InitShmLinks failure 3");
+    if (ok == 0) continue;
+    uint64_t capacity = shm_buffer_size, nonce = channels[i]->Nonce();
+    links[i]->sock.SendStr(channels[i]->Name());
+    Assert(links[i]->sock.SendAll(&capacity, sizeof(capacity)) == sizeof(capacity),
+           "InitShmLinks failure 3");
+    Assert(links[i]->sock.SendAll(&nonce, sizeof(nonce)) == sizeof(nonce),
+           "InitShmLinks failure 3");
+  }
+  // the other node opens it, and tells whether it succeeds,
+  // the segment may not be visible if the tracker is wrong about the host
+  for (size_t i = 0; i < links.size(); ++i) {
+    if (!use_shm[i] || rank < links[i]->rank) continue;
+    char ok;
+    Assert(links[i]->sock.RecvAll(&ok, sizeof(ok)) == sizeof(ok),
+           "InitShmLinks failure 4");
+    if (ok == 0) continue;
+    std::string name;
+    uint64_t capacity, nonce;
+    links[i]->sock.RecvStr(&name);
+    Assert(links[i]->sock.RecvAll(&capacity, sizeof(capacity)) == sizeof(capacity),
+           "InitShmLinks failure 4");
+    Assert(links[i]->sock.RecvAll(&nonce, sizeof(nonce)) == sizeof(nonce),
+           "InitShmLinks failure 4");
+    channels[i] = utils::ShmChannel::Open(name, static_cast<size_t>(capacity), nonce);
+    ok = channels[i] != NULL;
+    Assert(links[i]->sock.SendAll(&ok, sizeof(ok)) == sizeof(ok),
+           "InitShmLinks failure 5");
+  }
+  for (size_t i = 0; i < links.size(); ++i) {
+    if (channels[i] == NULL || rank > links[i]->rank) continue;
+    char ok;
+    Assert(links[i]->sock.RecvAll(&ok, sizeof(ok)) == sizeof(ok),
+           "InitShmLinks failure 6");
+    // both sides have mapped the segment, the name is no longer needed
+    channels[i]->Unlink();
+    if (ok == 0) {
+      delete channels[i]; channels[i] = NULL;
+    }
+  }
+  for (size_t i = 0; i < links.size(); ++i) {
+    if (channels[i] != NULL) links[i]->sock.AttachShm(channels[i]);
+  }
+}
+// names of allreduce methods in the table of auto tuning, in the order of AllreduceMethod
+static const char *kAllreduceMethodName[] = {
+  "tree", "double_tree", "halving_doubling", "ring", "hierarchical"
+};
+// names of broadcast methods in the table of auto tuning, in the order of BroadcastMethod
+static const char *kBcastMethodName[] = {"auto", "tree", "chain", "scatter"};
+// find the method by name, return -1 if not found
+inline int FindMethodName(const char *names[], int nname, const std::string &name) {
+  for (int i = 0; i < nname; ++i) {
+    if (name == names[i]) return i;
+  }
+  return -1;
+}
+/*!
+ * \brief load the table from text
+ * \param text the text given by Str
+ * \param world_size the table is only valid for the world size it is calibrated for
+ * \return whether the text is a valid table
+ */
+bool AllreduceBase::TuneTable::Load(const std::string &text, int world_size) {
+  std::istringstream is(text);
+  std::string line;
+  int nworker = -1;
+  size.clear(); allreduce.clear(); bcast.clear();
+  while (std::getline(is, line)) {
+    if (line.length() == 0 || line[0] == '#') continue;
+    std::istringstream ls(line);
+    if (nworker == -1) {
+      std::string key;
+      if (!(ls >> key >> nworker) || key != "world_size") return false;
+      continue;
+    }
+    size_t n;
+    std::string aname, bname;
+    if (!(ls >> n >> aname >> bname)) return false;
+    int a = FindMethodName(kAllreduceMethodName, kNumAllreduceMethod, aname);
+    int b = FindMethodName(kBcastMethodName, kBcastScatter + 1, bname);
+    if (a == -1 || b == -1 || b == kBcastAuto) return false;
+    if (size.size() != 0 && n <= size.back()) return false;
+    size.push_back(n); allreduce.push_back(a); bcast.push_back(b);
+  }
+  if (nworker != world_size || size.size() == 0) {
+    size.clear(); allreduce.clear(); bcast.clear();
+    return false;
+  }
+  return true;
+}
+/*!
+ * \brief save the table in text, which can be edited by hand
+ * \param world_size world size the table is calibrated for
+ */
+std::string AllreduceBase::TuneTable::Str(int world_size) const {
+  std::ostringstream os;
+  os << "# rabit auto tuning table, each line gives the allreduce and broadcast method\n"
+     << "# used for messages no larger than the size in bytes\n"
+     << "world_size " << world_size << '\n';
+  for (size_t i = 0; i < size.size(); ++i) {
+    os << size[i] << ' ' << kAllreduceMethodName[allreduce[i]]
+       << ' ' << kBcastMethodName[bcast[i]] << '\n';
+  }
+  return os.str();
+}
+/*!
+ * \brief setup the table of auto tuning, the table is taken from tracker if some node
+ *  already made it, otherwise rank 0 loads it from file or all the nodes calibrate it together,
+ *  if a link fails during the tuning, all the nodes reconnect and use the default methods
+ *  unless rank 0 already kept the table in tracker
+ */
+void AllreduceBase::InitAutoTune(void) {
+  if (world_size <= 1) return;
+  std::string table = tracker_tune_table;
+  // a node restarted after failure takes the table made at start from tracker
+  if (table.length() == 0) {
+    if (this->TryMakeTuneTable(&table) != kSuccess) {
+      // shutdown all the links and reconnect as the recovery does, so that the other nodes
+      // leave the tuning as well, the table is taken from tracker if rank 0 kept it
+      for (size_t i = 0; i < all_links.size(); ++i) {
+        if (!all_links[i].sock.BadSocket()) all_links[i].sock.Close();
+      }
+      this->ReConnectLinks("recover");
+      if (tune_table.empty()) {
+        utils::Printf("[%d] auto tuning failed, the default methods are used\n", rank);
+      }
+      return;
+    }
+  }
+  utils::Check(tune_table.Load(table, world_size), "invalid table of auto tuning");
+  if (autotune_dump != 0 && rank == 0) {
+    this->TrackerPrint(table);
+  }
+}
+/*!
+ * \brief make the table of auto tuning together in all the nodes at start up
+ * \param p_table used to store the table in text format
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ */
+AllreduceBase::ReturnType AllreduceBase::TryMakeTuneTable(std::string *p_table) {
+  std::string &table = *p_table;
+  ReturnType ret;
+  // all the nodes start together, the ones with different table make the collectives mismatch,
+  // so only rank 0 reads the file
+  if (rank == 0 && autotune_file != "NULL") {
+    std::FILE *fi = std::fopen(autotune_file.c_str(), "rb");
+    if (fi != NULL) {
+      char buf[1024];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), fi)) != 0) table.append(buf, n);
+      fclose(fi);
+    }
+    // ignore the file made for another world size
+    TuneTable check;
+    if (!check.Load(table, world_size)) table.clear();
+  }
+  uint64_t len = table.length();
+  ret = TryBroadcast(&len, sizeof(len), 0);
+  if (ret != kSuccess) return ret;
+  if (len != 0) {
+    table.resize(len);
+    ret = TryBroadcast(&table[0], len, 0);
+    if (ret != kSuccess) return ret;
+  } else {
+    ret = this->TryCalibrateTuneTable(&table);
+    if (ret != kSuccess) return ret;
+    if (rank == 0 && autotune_file != "NULL") {
+      std::FILE *fo = utils::FopenCheck(autotune_file.c_str(), "wb");
+      fwrite(table.c_str(), 1, table.length(), fo);
+      fclose(fo);
+    }
+  }
+  // keep the table in tracker for nodes restarted later,
+  // the nodes failed before taking the table get it when they reconnect
+  if (rank == 0) {
+    utils::TCPSocket tracker = this->ConnectTracker();
+    tracker.SendStr(std::string("tune"));
+    tracker.SendStr(table);
+    tracker.Close();
+  }
+  // no node leaves before the tracker gets the table,
+  // otherwise a node failed right after could restart without it
+  int done = 0;
+  return TryBroadcast(&done, sizeof(done), 0);
+}
+/*!
+ * \brief benchmark the methods of allreduce and broadcast over a grid of message sizes,
+ *  and choose the fastest one for each size by the time of the slowest node
+ * \param p_table used to store the table in text format, which is the same in all the nodes
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ */
+AllreduceBase::ReturnType AllreduceBase::TryCalibrateTuneTable(std::string *p_table) {
+  const int kNumBcastMethod = kBcastScatter + 1;
+  const int nmethod = kNumAllreduceMethod + kNumBcastMethod;
+  TuneTable tune;
+  for (size_t n = 8; n <= autotune_max; n *= 4) tune.size.push_back(n);
+  // time of each method of each size, methods not available take infinite time
+  std::vector<double> cost(tune.size.size() * nmethod, std::numeric_limits<double>::max());
+  std::vector<float> data(tune.size.back() / sizeof(float), 1.0f);
+  for (size_t i = 0; i < tune.size.size(); ++i) {
+    const size_t count = tune.size[i] / sizeof(float);
+    // run more rounds for small messages, whose time is less stable
+    const int nround = tune.size[i] <= (64UL << 10UL) ? 10 : 3;
+    for (int m = 0; m < nmethod; ++m) {
+      if (m < kNumAllreduceMethod && !AllreduceMethodAvailable(m, count)) continue;
+      const int bmethod = m - kNumAllreduceMethod;
+      if (bmethod == kBcastAuto) continue;
+      if (bmethod > kBcastTree && (ring_prev == NULL || ring_next == NULL)) continue;
+      // start all the nodes together
+      int sync = 0;
+      ReturnType ret = TryAllreduceTree(&sync, sizeof(sync), 1, op::Reducer<op::Max, int>);
+      if (ret != kSuccess) return ret;
+      double start = 0.0;
+      // the first round warms up the links
+      for (int r = 0; r <= nround; ++r) {
+        if (r == 1) start = utils::GetTime();
+        if (m < kNumAllreduceMethod) {
+          ret = TryAllreduceMethod(m, BeginPtr(data), sizeof(float), count,
+                                   op::Reducer<op::Max, float>);
+        } else if (bmethod == kBcastChain) {
+          ret = TryBroadcastRing(BeginPtr(data), tune.size[i], 0);
+        } else if (bmethod == kBcastScatter) {
+          ret = TryBroadcastScatter(BeginPtr(data), tune.size[i], 0);
+        } else {
+          ret = TryBroadcastTree(BeginPtr(data), tune.size[i], 0);
+        }
+        if (ret != kSuccess) return ret;
+      }
+      cost[i * nmethod + m] = (utils::GetTime() - start) / nround;
+    }
+  }
+  // the slowest node decides the time of each method
+  ReturnType ret = TryAllreduceTree(BeginPtr(cost), sizeof(double), cost.size(),
+                                    op::Reducer<op::Max, double>);
+  if (ret != kSuccess) return ret;
+  for (size_t i = 0; i < tune.size.size(); ++i) {
+    const double *c = &cost[i * nmethod];
+    tune.allreduce.push_back(static_cast<int>(
+        std::min_element(c, c + kNumAllreduceMethod) - c));
+    tune.bcast.push_back(static_cast<int>(
+        std::min_element(c + kNumAllreduceMethod + kBcastTree, c + nmethod) - (c + kNumAllreduceMethod)));
+  }
+  *p_table = tune.Str(world_size);
+  return kSuccess;
+}
+// argument of PrepareWire
+struct WirePrepare {
+  // preprocessing of user
+  IEngine::PreprocFunction *prepare_fun;
+  void *prepare_arg;
+  // float data of user and the data in wire format
+  const float *data;
+  uint16_t *wire;
+  size_t count;
+  utils::FloatFormat fmt;
+};
+// run the preprocessing of user, then convert the data into wire format
+inline void PrepareWire(void *arg_) {
+  WirePrepare *arg = static_cast<WirePrepare*>(arg_);
+  if (arg->prepare_fun != NULL) arg->prepare_fun(arg->prepare_arg);
+  utils::FloatToHalf(arg->data, arg->wire, arg->count, arg->fmt);
+}
+// sum of data in 16 bit format, the data received is added to the partial sum
+// of this node kept in float, and only the partial sum to be sent is rounded
+template<utils::FloatFormat fmt>
+inline void ReduceSumHalf(const void *src_, void *dst_, int len, const MPI::Datatype &dtype) {
+  const WireSum *ws = static_cast<const WireSum*>(dtype.state);
+  utils::Assert(ws != NULL && ws->data != NULL, "ReduceSumHalf: no float sum is running");
+  const uint16_t *src = static_cast<const uint16_t*>(src_);
+  uint16_t *dst = static_cast<uint16_t*>(dst_);
+  utils::Assert(dst >= ws->wire && dst + len <= ws->wire + ws->acc.size(),
+                "ReduceSumHalf: must reduce into the buffer of allreduce");
+  float *acc = const_cast<float*>(BeginPtr(ws->acc)) + (dst - ws->wire);
+  const int kBlock = 256;
+  float a[kBlock];
+  for (int i = 0; i < len; i += kBlock) {
+    const int n = std::min(len - i, kBlock);
+    utils::HalfToFloat(src + i, a, n, fmt);
+    for (int j = 0; j < n; ++j) acc[i + j] += a[j];
+    utils::FloatToHalf(acc + i, dst + i, n, fmt);
+  }
+}
+/*!
+ * \brief perform in-place allreduce of float sum, the data can be passed in 16 bit
+ *  floating point on the wire to halve the bytes sent, see rabit_wire_dtype
+ * \param sendrecvbuf buffer for both sending and recving data
+ * \param count number of elements to be reduced
+ * \param reducer reduce function of float sum, used when data is passed in 32 bit
+ * \param prepare_fun Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+ *                     will be called by the function before performing Allreduce, to intialize the data in sendrecvbuf_.
+ *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to passed into the lazy preprocessing function
+ */
+void AllreduceBase::AllreduceSumFloat(float *sendrecvbuf,
+                                      size_t count,
+                                      ReduceFunction reducer,
+                                      PreprocFunction prepare_fun,
+                                      void *prepare_arg) {
+  // a single node does not send anything, keep the full precision
+  if (wire_dtype == utils::kFP32 || GetWorldSize() == 1 || count == 0) {
+    this->Allreduce(sendrecvbuf, sizeof(float), count, reducer, prepare_fun, prepare_arg);
+    return;
+  }
+  // the data is converted after the preprocessing, which is skipped when the result is recovered
+  wire_buffer.resize(count);
+  WirePrepare arg;
+  arg.prepare_fun = prepare_fun;
+  arg.prepare_arg = prepare_arg;
+  arg.data = sendrecvbuf;
+  arg.wire = BeginPtr(wire_buffer);
+  arg.count = count;
+  arg.fmt = wire_dtype;
+  // the float data of user is kept until the end, each try on the data starts from it,
+  // see TryAllreduceData, the other messages of the engine do not use it
+  wire_sum.data = sendrecvbuf;
+  if (wire_dtype == utils::kFP16) {
+    this->Allreduce(BeginPtr(wire_buffer), sizeof(uint16_t), count,
+                    ReduceSumHalf<utils::kFP16>, PrepareWire, &arg);
+  } else {
+    this->Allreduce(BeginPtr(wire_buffer), sizeof(uint16_t), count,
+                    ReduceSumHalf<utils::kBF16>, PrepareWire, &arg);
+  }
+  wire_sum.data = NULL;
+  utils::HalfToFloat(BeginPtr(wire_buffer), sendrecvbuf, count, wire_dtype);
 }
 /*!
  * \brief perform in-place allreduce, on sendrecvbuf, this function can fail, and will return the cause of failure
@@ -328,59 +1001,322 @@ AllreduceBase::TryAllreduce(void *sendrecvbuf_,
                             size_t type_nbytes,
                             size_t count,
                             ReduceFunction reducer) {
-  RefLinkVector &links = tree_links;
-  if (links.size() == 0 || count == 0) return kSuccess;
-  // total size of message
+  // the decision only depends on message size and parameters of the job,
+  // so all the nodes take the same path, the choice between the small message tree and
+  // the streaming tree depends on the number of links of each node, which is left to
+  // TryAllreduceMethod, as the two are compatible on the wire
   const size_t total_size = type_nbytes * count;
-  // number of links
-  const int nlink = static_cast<int>(links.size());
-  // send recv buffer
+  int method = kAllreduceTree;
+  if (!tune_table.empty() &&
+      AllreduceMethodAvailable(tune_table.allreduce[tune_table.Index(total_size)], count)) {
+    method = tune_table.allreduce[tune_table.Index(total_size)];
+  } else if (use_hierarchical != 0 &&
+             !(count > static_cast<size_t>(world_size) && total_size > ring_threshold &&
+               ring_prev != NULL && ring_next != NULL)) {
+    // in hierarchical mode, messages that are not reduced along the ring go through the host leaders,
+    // the ring is kept for large messages as it already crosses each host boundary only once
+    method = kAllreduceHierarchical;
+  } else if (total_size <= small_threshold) {
+    method = kAllreduceTree;
+  } else if (count > static_cast<size_t>(world_size) && total_size > ring_threshold &&
+             ring_prev != NULL && ring_next != NULL) {
+    method = kAllreduceRing;
+  } else if (count > static_cast<size_t>(world_size) && total_size > halving_threshold &&
+             hd_links.size() != 0) {
+    method = kAllreduceHalvingDoubling;
+  } else if (use_double_tree != 0 && num_dtree == 2 && count > 1) {
+    // split the data between the two trees of double binary tree
+    method = kAllreduceDoubleTree;
+  }
+  return TryAllreduceMethod(method, sendrecvbuf_, type_nbytes, count, reducer);
+}
+/*!
+ * \brief perform in-place allreduce on the data of user, this is TryAllreduce that also
+ *  starts the partial sums in float of AllreduceSumFloat on the buffer of this try,
+ *  the engines use it for the data of Allreduce, and TryAllreduce for their own messages
+ * \param sendrecvbuf_ buffer for both sending and recving data, it can be a copy of the data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceData(void *sendrecvbuf_,
+                                size_t type_nbytes,
+                                size_t count,
+                                ReduceFunction reducer) {
+  if (wire_sum.data != NULL) {
+    // float sum passed in 16 bit, each try starts from the float data of this node
+    wire_sum.wire = static_cast<const uint16_t*>(sendrecvbuf_);
+    wire_sum.acc.assign(wire_sum.data, wire_sum.data + count);
+  }
+  return TryAllreduce(sendrecvbuf_, type_nbytes, count, reducer);
+}
+/*!
+ * \brief whether the method of allreduce can be used for the message,
+ *  the result is the same in all the nodes
+ * \param method the method, see AllreduceMethod
+ * \param count number of elements to be reduced
+ */
+bool AllreduceBase::AllreduceMethodAvailable(int method, size_t count) const {
+  switch (method) {
+    case kAllreduceTree: return true;
+    case kAllreduceDoubleTree: return num_dtree == 2 && count > 1;
+    case kAllreduceHalvingDoubling:
+      return count > static_cast<size_t>(world_size) && hd_links.size() != 0;
+    case kAllreduceRing:
+      return count > static_cast<size_t>(world_size) && ring_prev != NULL && ring_next != NULL;
+    case kAllreduceHierarchical: return this->NeedHierarchical();
+    default: return false;
+  }
+}
+/*!
+ * \brief perform in-place allreduce with the given method
+ * \param method the method, see AllreduceMethod
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceMethod(int method,
+                                  void *sendrecvbuf_,
+                                  size_t type_nbytes,
+                                  size_t count,
+                                  ReduceFunction reducer) {
+  switch (method) {
+    case kAllreduceDoubleTree:
+      return TryAllreduceDoubleTree(sendrecvbuf_, type_nbytes, count, reducer);
+    case kAllreduceHalvingDoubling:
+      return TryAllreduceHalvingDoubling(sendrecvbuf_, type_nbytes, count, reducer);
+    case kAllreduceRing:
+      return TryAllreduceRing(sendrecvbuf_, type_nbytes, count, reducer);
+    case kAllreduceHierarchical:
+      return TryAllreduceHierarchical(sendrecvbuf_, type_nbytes, count, reducer);
+    default: {
+      // decided by each node, each link takes one 64 bit aligned slot in the stack buffer
+      const size_t total_size = type_nbytes * count;
+      const size_t nslot_bytes = (total_size + 7) / 8 * 8 * tree_links.size();
+      if (total_size <= small_threshold && nslot_bytes <= kSmallBufferSize) {
+        return TryAllreduceSmall(sendrecvbuf_, type_nbytes, count, reducer);
+      }
+      return TryAllreduceTree(sendrecvbuf_, type_nbytes, count, reducer);
+    }
+  }
+}
+/*!
+ * \brief perform in-place allreduce, on sendrecvbuf,
+ *  using the reduction tree, this is the latency optimal method for small messages
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceTree(void *sendrecvbuf_,
+                                size_t type_nbytes,
+                                size_t count,
+                                ReduceFunction reducer) {
+  TreeTask task;
+  task.links = &tree_links;
+  task.parent_index = parent_index;
+  task.sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  task.total_size = type_nbytes * count;
+  return TryAllreduceTreeTasks(&task, 1, type_nbytes, reducer);
+}
+/*!
+ * \brief perform in-place allreduce, on sendrecvbuf, using double binary tree,
+ *  the first half of data is reduced along one tree and the other half along the other tree
+ *  concurrently, a leaf in one tree is interior node in the other one,
+ *  so the bandwidth of all the nodes in both directions is used
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceDoubleTree(void *sendrecvbuf_,
+                                      size_t type_nbytes,
+                                      size_t count,
+                                      ReduceFunction reducer) {
+  utils::Assert(num_dtree == 2, "double binary tree is not available");
   char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
-  // size of space that we already performs reduce in up pass
-  size_t size_up_reduce = 0;
-  // size of space that we have already passed to parent
-  size_t size_up_out = 0;
-  // size of message we received, and send in the down pass
-  size_t size_down_in = 0;
-  // initialize the link ring-buffer and pointer
+  const size_t count0 = count / 2;
+  TreeTask tasks[2];
+  for (int k = 0; k < 2; ++k) {
+    tasks[k].links = &dtree_links[k];
+    tasks[k].parent_index = dtree_parent_index[k];
+  }
+  tasks[0].sendrecvbuf = sendrecvbuf;
+  tasks[0].total_size = count0 * type_nbytes;
+  tasks[1].sendrecvbuf = sendrecvbuf + count0 * type_nbytes;
+  tasks[1].total_size = (count - count0) * type_nbytes;
+  return TryAllreduceTreeTasks(tasks, 2, type_nbytes, reducer);
+}
+/*!
+ * \brief perform in-place allreduce, on sendrecvbuf, hierarchically:
+ *  the data is first reduced to the leader of each host, then allreduced among the leaders,
+ *  and the result is broadcasted back inside each host, the three steps are pipelined
+ *  along the tree given by tracker, in which only links between leaders go across hosts
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceHierarchical(void *sendrecvbuf_,
+                                        size_t type_nbytes,
+                                        size_t count,
+                                        ReduceFunction reducer) {
+  TreeTask task;
+  task.links = &hier_links;
+  task.parent_index = hier_parent_index;
+  task.sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  task.total_size = type_nbytes * count;
+  return TryAllreduceTreeTasks(&task, 1, type_nbytes, reducer);
+}
+/*!
+ * \brief reduce the data that all the children of the tree have passed up
+ * \param p_task the tree task
+ * \param type_nbytes the unit number of bytes the type have
+ * \param reducer reduce function
+ */
+void AllreduceBase::ReduceTreeTask(TreeTask *p_task, size_t type_nbytes,
+                                   ReduceFunction reducer) {
+  TreeTask &t = *p_task;
+  RefLinkVector &links = *t.links;
+  const int nlink = static_cast<int>(links.size());
+  const int parent_index = t.parent_index;
+  // no childs, no need to reduce
+  if (nlink == static_cast<int>(parent_index != -1)) return;
+  size_t buffer_size = 0;
+  // do upstream reduce
+  size_t max_reduce = t.total_size;
   for (int i = 0; i < nlink; ++i) {
     if (i != parent_index) {
-      links[i].InitBuffer(type_nbytes, count, reduce_buffer_size);
+      max_reduce= std::min(max_reduce, links[i].size_read);
+      utils::Assert(buffer_size == 0 || buffer_size == links[i].buffer_size,
+                    "buffer size inconsistent");
+      buffer_size = links[i].buffer_size;
     }
-    links[i].ResetSize();
   }
-  // if no childs, no need to reduce
-  if (nlink == static_cast<int>(parent_index != -1)) {
-    size_up_reduce = total_size;
+  utils::Assert(buffer_size != 0, "must assign buffer_size");
+  // round to type_n4bytes
+  max_reduce = (max_reduce / type_nbytes * type_nbytes);
+  // peform reduce, can be at most two rounds
+  while (t.size_up_reduce < max_reduce) {
+    // start position
+    size_t start = t.size_up_reduce % buffer_size;
+    // peform read till end of buffer
+    size_t nread = std::min(buffer_size - start,
+                            max_reduce - t.size_up_reduce);
+    utils::Assert(nread % type_nbytes == 0, "Allreduce: size check");
+    for (int i = 0; i < nlink; ++i) {
+      if (i != parent_index) {
+        reducer(links[i].buffer_head + start,
+                t.sendrecvbuf + t.size_up_reduce,
+                static_cast<int>(nread / type_nbytes),
+                MPI::Datatype(type_nbytes, &wire_sum));
+      }
+    }
+    t.size_up_reduce += nread;
+  }
+}
+/*!
+ * \brief run allreduce along several trees at the same time,
+ *  the trees must not share links with each other
+ *
+ * \param tasks the trees and the part of data reduced by each of them
+ * \param ntask number of tasks
+ * \param type_nbytes the unit number of bytes the type have
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduceTree
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceTreeTasks(TreeTask *tasks, int ntask,
+                                     size_t type_nbytes,
+                                     ReduceFunction reducer) {
+  for (int k = 0; k < ntask; ++k) {
+    TreeTask &t = tasks[k];
+    RefLinkVector &links = *t.links;
+    const int nlink = static_cast<int>(links.size());
+    t.size_up_reduce = t.size_up_out = t.size_down_in = 0;
+    // initialize the link ring-buffer and pointer
+    const size_t buffer_size =
+        ChildBufferSize(nlink - static_cast<int>(t.parent_index != -1), type_nbytes);
+    for (int i = 0; i < nlink; ++i) {
+      if (i != t.parent_index && t.total_size != 0) {
+        links[i].InitBuffer(type_nbytes, t.total_size / type_nbytes, buffer_size);
+      }
+      links[i].ResetSize();
+    }
+    // if no childs, no need to reduce
+    if (nlink == static_cast<int>(t.parent_index != -1)) {
+      t.size_up_reduce = t.total_size;
+    }
+  }
+  if (uring.IsOpen()) {
+    // io_uring only passes data of TCP links, with three operations in flight for each link
+    bool socket_only = true;
+    size_t nops = 0;
+    for (int k = 0; k < ntask; ++k) {
+      RefLinkVector &links = *tasks[k].links;
+      for (size_t i = 0; i < links.size(); ++i) {
+        if (links[i].sock.shm != NULL) socket_only = false;
+        nops += 3;
+      }
+    }
+    if (socket_only && nops <= uring.Capacity()) {
+      return TryAllreduceTreeTasksURing(tasks, ntask, type_nbytes, reducer);
+    }
   }
   // while we have not passed the messages out
   while (true) {
     // select helper
     bool finished = true;
-    utils::SelectHelper selecter;
-    for (int i = 0; i < nlink; ++i) {
-      if (i == parent_index) {
-        if (size_down_in != total_size) {
-          selecter.WatchRead(links[i].sock);
-          // only watch for exception in live channels
-          selecter.WatchException(links[i].sock);
-          finished = false;
-        }
-        if (size_up_out != total_size && size_up_out < size_up_reduce) {
-          selecter.WatchWrite(links[i].sock);
-        }
-      } else {
-        if (links[i].size_read != total_size) {
-          selecter.WatchRead(links[i].sock);
-        }
-        // size_write <= size_read
-        if (links[i].size_write != total_size){
-          if (links[i].size_write < size_down_in) {
+    utils::PollHelper &selecter = poller.Begin();
+    for (int k = 0; k < ntask; ++k) {
+      const TreeTask &t = tasks[k];
+      RefLinkVector &links = *t.links;
+      const int nlink = static_cast<int>(links.size());
+      const size_t total_size = t.total_size;
+      for (int i = 0; i < nlink; ++i) {
+        if (i == t.parent_index) {
+          if (t.size_down_in != total_size) {
+            selecter.WatchRead(links[i].sock);
+            // only watch for exception in live channels
+            selecter.WatchException(links[i].sock);
+            finished = false;
+          }
+          if (t.size_up_out != total_size && t.size_up_out < t.size_up_reduce) {
             selecter.WatchWrite(links[i].sock);
           }
-          // only watch for exception in live channels
-          selecter.WatchException(links[i].sock);
-          finished = false;
+        } else {
+          if (links[i].size_read != total_size) {
+            selecter.WatchRead(links[i].sock);
+          }
+          // size_write <= size_read
+          if (links[i].size_write != total_size){
+            if (links[i].size_write < t.size_down_in) {
+              selecter.WatchWrite(links[i].sock);
+            }
+            // only watch for exception in live channels
+            selecter.WatchException(links[i].sock);
+            finished = false;
+          }
         }
       }
     }
@@ -388,103 +1324,791 @@ AllreduceBase::TryAllreduce(void *sendrecvbuf_,
     if (finished) break;
     // select must return
     selecter.Select();
-    // exception handling
-    for (int i = 0; i < nlink; ++i) {
-      // recive OOB message from some link
-      if (selecter.CheckExcept(links[i].sock)) {
-        return ReportError(&links[i], kGetExcept);
-      }
-    }
-    // read data from childs
-    for (int i = 0; i < nlink; ++i) {
-      if (i != parent_index && selecter.CheckRead(links[i].sock)) {
-        ReturnType ret = links[i].ReadToRingBuffer(size_up_out);
-        if (ret != kSuccess) {
-          return ReportError(&links[i], ret);
+    for (int k = 0; k < ntask; ++k) {
+      TreeTask &t = tasks[k];
+      RefLinkVector &links = *t.links;
+      const int nlink = static_cast<int>(links.size());
+      const int parent_index = t.parent_index;
+      const size_t total_size = t.total_size;
+      char *sendrecvbuf = t.sendrecvbuf;
+      // nothing is passed along this tree
+      if (total_size == 0) continue;
+      // exception handling
+      for (int i = 0; i < nlink; ++i) {
+        // recive OOB message from some link
+        if (selecter.CheckExcept(links[i].sock)) {
+          return ReportError(&links[i], kGetExcept);
         }
       }
-    }
-    // this node have childs, peform reduce
-    if (nlink > static_cast<int>(parent_index != -1)) {
-      size_t buffer_size = 0;
-      // do upstream reduce
+      // read data from childs
+      for (int i = 0; i < nlink; ++i) {
+        if (i != parent_index && selecter.CheckRead(links[i].sock)) {
+          ReturnType ret = links[i].ReadToRingBuffer(t.size_up_out, total_size);
+          if (ret != kSuccess) {
+            return ReportError(&links[i], ret);
+          }
+        }
+      }
+      // this node have childs, peform reduce
+      ReduceTreeTask(&t, type_nbytes, reducer);
+      if (parent_index != -1) {
+        // pass message up to parent, can pass data that are already been reduced
+        if (t.size_up_out < t.size_up_reduce) {
+          ssize_t len = links[parent_index].sock.
+              Send(sendrecvbuf + t.size_up_out, t.size_up_reduce - t.size_up_out);
+          if (len != -1) {
+            t.size_up_out += static_cast<size_t>(len);
+          } else {
+            ReturnType ret = Errno2Return(errno);
+            if (ret != kSuccess) {
+              return ReportError(&links[parent_index], ret);
+            }
+          }
+        }
+        // read data from parent
+        if (selecter.CheckRead(links[parent_index].sock) &&
+            total_size > t.size_down_in) {
+          ssize_t len = links[parent_index].sock.
+              Recv(sendrecvbuf + t.size_down_in, total_size - t.size_down_in);
+          if (len == 0) {
+            links[parent_index].sock.Close();
+            return ReportError(&links[parent_index], kRecvZeroLen);
+          }
+          if (len != -1) {
+            t.size_down_in += static_cast<size_t>(len);
+            utils::Assert(t.size_down_in <= t.size_up_out,
+                          "Allreduce: boundary error");
+          } else {
+            ReturnType ret = Errno2Return(errno);
+            if (ret != kSuccess) {
+              return ReportError(&links[parent_index], ret);
+            }
+          }
+        }
+      } else {
+        // this is root, can use reduce as most recent point
+        t.size_down_in = t.size_up_out = t.size_up_reduce;
+      }
+      // can pass message down to childs
+      for (int i = 0; i < nlink; ++i) {
+        if (i != parent_index && links[i].size_write < t.size_down_in) {
+          ReturnType ret = links[i].WriteFromArray(sendrecvbuf, t.size_down_in);
+          if (ret != kSuccess) {
+            return ReportError(&links[i], ret);
+          }
+        }
+      }
+    }
+  }
+  return kSuccess;
+}
+/*!
+ * \brief the same as TryAllreduceTreeTasks, but the data of links are passed by io_uring,
+ *  each link keeps a receive and a send in flight, and the completions are reaped in batch,
+ *  the links must not use shared memory
+ *
+ * \param tasks the trees and the part of data reduced by each of them
+ * \param ntask number of tasks
+ * \param type_nbytes the unit number of bytes the type have
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduceTreeTasks
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceTreeTasksURing(TreeTask *tasks, int ntask,
+                                          size_t type_nbytes,
+                                          ReduceFunction reducer) {
+  // the user data of an operation is the index of link among all tasks, and the kind of operation
+  enum OpKind {
+    kOpRecv = 0, kOpSend = 1, kOpExcept = 2, kOpCancel = 3
+  };
+  // largest size of one receive or send
+  const size_t kMaxOpSize = 1 << 30;
+  std::vector<int> task_of, link_of;
+  for (int k = 0; k < ntask; ++k) {
+    for (size_t i = 0; i < tasks[k].links->size(); ++i) {
+      task_of.push_back(k); link_of.push_back(static_cast<int>(i));
+    }
+  }
+  // the operations of each link in flight, bit (1 << OpKind) is set when the operation is in flight
+  std::vector<int> inflight(task_of.size(), 0);
+  // the buffers must not be used by kernel after return, cancel and wait for the operations
+  struct Drain {
+    utils::URing *uring;
+    std::vector<int> *inflight;
+    ~Drain(void) {
+      std::vector<int> &ops = *inflight;
+      bool pending = false;
+      for (size_t j = 0; j < ops.size(); ++j) {
+        for (int kind = kOpRecv; kind < kOpCancel; ++kind) {
+          if ((ops[j] >> kind) & 1) {
+            uring->PrepCancel(j << 2 | kind, j << 2 | kOpCancel);
+            pending = true;
+          }
+        }
+      }
+      while (pending) {
+        uring->Submit(1);
+        uint64_t data; int res;
+        while (uring->Reap(&data, &res)) {
+          if ((data & 3) != kOpCancel) ops[data >> 2] &= ~(1 << (data & 3));
+        }
+        pending = false;
+        for (size_t j = 0; j < ops.size(); ++j) pending = pending || ops[j] != 0;
+      }
+    }
+  } drain;
+  drain.uring = &uring; drain.inflight = &inflight;
+  while (true) {
+    bool finished = true;
+    // keep the operations of each link in flight
+    for (size_t j = 0; j < inflight.size(); ++j) {
+      TreeTask &t = tasks[task_of[j]];
+      const int i = link_of[j];
+      LinkRecord &link = (*t.links)[i];
+      const int fd = static_cast<SOCKET>(link.sock);
+      const size_t total_size = t.total_size;
+      if (total_size == 0) continue;
+      bool live = false;
+      if (i == t.parent_index) {
+        if (t.size_down_in != total_size) {
+          live = true;
+          finished = false;
+          if ((inflight[j] & (1 << kOpRecv)) == 0) {
+            uring.PrepRecv(fd, t.sendrecvbuf + t.size_down_in,
+                           std::min(total_size - t.size_down_in, kMaxOpSize), j << 2 | kOpRecv);
+            inflight[j] |= 1 << kOpRecv;
+          }
+        }
+        if (t.size_up_out < t.size_up_reduce && (inflight[j] & (1 << kOpSend)) == 0) {
+          uring.PrepSend(fd, t.sendrecvbuf + t.size_up_out,
+                         std::min(t.size_up_reduce - t.size_up_out, kMaxOpSize), j << 2 | kOpSend);
+          inflight[j] |= 1 << kOpSend;
+        }
+      } else {
+        if (link.size_read != total_size && (inflight[j] & (1 << kOpRecv)) == 0) {
+          // the same space as ReadToRingBuffer, which does not override data not yet passed up
+          const size_t ngap = link.size_read - t.size_up_out;
+          const size_t offset = link.size_read % link.buffer_size;
+          size_t nmax = std::min(link.buffer_size - ngap, link.buffer_size - offset);
+          nmax = std::min(nmax, total_size - link.size_read);
+          if (nmax != 0) {
+            uring.PrepRecv(fd, link.buffer_head + offset,
+                           std::min(nmax, kMaxOpSize), j << 2 | kOpRecv);
+            inflight[j] |= 1 << kOpRecv;
+          }
+        }
+        if (link.size_write != total_size) {
+          live = true;
+          finished = false;
+          if (link.size_write < t.size_down_in && (inflight[j] & (1 << kOpSend)) == 0) {
+            uring.PrepSend(fd, t.sendrecvbuf + link.size_write,
+                           std::min(t.size_down_in - link.size_write, kMaxOpSize),
+                           j << 2 | kOpSend);
+            inflight[j] |= 1 << kOpSend;
+          }
+        }
+      }
+      // only watch for exception in live channels
+      if (live && (inflight[j] & (1 << kOpExcept)) == 0) {
+        uring.PrepPoll(fd, POLLPRI, j << 2 | kOpExcept);
+        inflight[j] |= 1 << kOpExcept;
+      }
+    }
+    if (finished) break;
+    bool ready = false;
+    if (busy_poll.spin_us > 0) {
+      // submit the operations, and spin on the completion queue before waiting in kernel
+      uring.Submit(0);
+      const double tstart = utils::GetTime();
+      while (!(ready = uring.Ready()) && busy_poll.Spinning(tstart)) {}
+      busy_poll.Count(tstart, ready);
+    }
+    // one system call submits the operations and waits for completions
+    if (!ready) uring.Submit(1);
+    uint64_t data; int res;
+    while (uring.Reap(&data, &res)) {
+      const size_t j = data >> 2;
+      const int kind = static_cast<int>(data & 3);
+      if (kind == kOpCancel) continue;
+      inflight[j] &= ~(1 << kind);
+      TreeTask &t = tasks[task_of[j]];
+      const int i = link_of[j];
+      LinkRecord &link = (*t.links)[i];
+      if (kind == kOpExcept) {
+        // recive OOB message from some link
+        if (res > 0 && (res & POLLPRI) != 0) return ReportError(&link, kGetExcept);
+        continue;
+      }
+      if (res < 0) {
+        ReturnType ret = Errno2Return(-res);
+        if (ret != kSuccess) return ReportError(&link, ret);
+        continue;
+      }
+      if (kind == kOpRecv) {
+        // length equals 0, remote disconnected
+        if (res == 0) {
+          link.sock.Close();
+          return ReportError(&link, kRecvZeroLen);
+        }
+        if (i == t.parent_index) {
+          t.size_down_in += static_cast<size_t>(res);
+          utils::Assert(t.size_down_in <= t.size_up_out,
+                        "Allreduce: boundary error");
+        } else {
+          link.size_read += static_cast<size_t>(res);
+        }
+      } else {
+        if (i == t.parent_index) {
+          t.size_up_out += static_cast<size_t>(res);
+        } else {
+          link.size_write += static_cast<size_t>(res);
+        }
+      }
+    }
+    for (int k = 0; k < ntask; ++k) {
+      TreeTask &t = tasks[k];
+      if (t.total_size == 0) continue;
+      ReduceTreeTask(&t, type_nbytes, reducer);
+      if (t.parent_index == -1) {
+        // this is root, can use reduce as most recent point
+        t.size_down_in = t.size_up_out = t.size_up_reduce;
+      }
+    }
+  }
+  return kSuccess;
+}
+/*!
+ * \brief perform in-place reduce toward root along the tree, this function can fail,
+ *  and will return the cause of failure. The tree is rooted at root,
+ *  only the up pass of tree allreduce is performed
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \param root the root worker id to get the result
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryReduce(void *sendrecvbuf_,
+                         size_t type_nbytes,
+                         size_t count,
+                         ReduceFunction reducer,
+                         int root) {
+  utils::Check(root >= 0 && root < GetWorldSize(), "Reduce: invalid root");
+  RefLinkVector &links = tree_links;
+  if (links.size() == 0 || count == 0) return kSuccess;
+  // total size of message
+  const size_t total_size = type_nbytes * count;
+  // number of links
+  const int nlink = static_cast<int>(links.size());
+  // send recv buffer
+  char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  // find the neighbor on the path to root: if current node is an ancestor of root,
+  // it is the child on the path, otherwise it is the parent
+  int out_index = -1;
+  if (root != rank) {
+    int out_rank = root;
+    while (out_rank != -1 && tree_parents[out_rank] != rank) {
+      out_rank = tree_parents[out_rank];
+    }
+    if (out_rank == -1) out_rank = parent_rank;
+    for (int i = 0; i < nlink; ++i) {
+      if (links[i].rank == out_rank) out_index = i;
+    }
+    utils::Assert(out_index != -1, "Reduce: cannot find the link toward root");
+  }
+  // size of space that we already performs reduce
+  size_t size_up_reduce = 0;
+  // size of space that we have already passed toward root
+  size_t size_up_out = 0;
+  const size_t buffer_size =
+      ChildBufferSize(nlink - static_cast<int>(out_index != -1), type_nbytes);
+  for (int i = 0; i < nlink; ++i) {
+    if (i != out_index) {
+      links[i].InitBuffer(type_nbytes, count, buffer_size);
+    }
+    links[i].ResetSize();
+  }
+  // if no input links, no need to reduce
+  if (nlink == static_cast<int>(out_index != -1)) {
+    size_up_reduce = total_size;
+  }
+  while (true) {
+    // select helper
+    bool finished = true;
+    utils::PollHelper &selecter = poller.Begin();
+    for (int i = 0; i < nlink; ++i) {
+      if (i == out_index) {
+        if (size_up_out != total_size) {
+          if (size_up_out < size_up_reduce) {
+            selecter.WatchWrite(links[i].sock);
+          }
+          selecter.WatchException(links[i].sock);
+          finished = false;
+        }
+      } else {
+        if (links[i].size_read != total_size) {
+          selecter.WatchRead(links[i].sock);
+          selecter.WatchException(links[i].sock);
+          finished = false;
+        }
+      }
+    }
+    // the root also waits until everything is reduced
+    if (out_index == -1 && size_up_reduce != total_size) finished = false;
+    if (finished) break;
+    selecter.Select();
+    // exception handling
+    for (int i = 0; i < nlink; ++i) {
+      if (selecter.CheckExcept(links[i].sock)) {
+        return ReportError(&links[i], kGetExcept);
+      }
+    }
+    // read data from input links
+    for (int i = 0; i < nlink; ++i) {
+      if (i != out_index && selecter.CheckRead(links[i].sock)) {
+        ReturnType ret = links[i].ReadToRingBuffer(size_up_reduce, total_size);
+        if (ret != kSuccess) {
+          return ReportError(&links[i], ret);
+        }
+      }
+    }
+    if (nlink > static_cast<int>(out_index != -1)) {
+      size_t buffer_size = 0;
       size_t max_reduce = total_size;
       for (int i = 0; i < nlink; ++i) {
-        if (i != parent_index) {
-          max_reduce= std::min(max_reduce, links[i].size_read);
-          utils::Assert(buffer_size == 0 || buffer_size == links[i].buffer_size,
-                        "buffer size inconsistent");
+        if (i != out_index) {
+          max_reduce = std::min(max_reduce, links[i].size_read);
           buffer_size = links[i].buffer_size;
         }
       }
       utils::Assert(buffer_size != 0, "must assign buffer_size");
-      // round to type_n4bytes
+      // round to type_nbytes
       max_reduce = (max_reduce / type_nbytes * type_nbytes);
       // peform reduce, can be at most two rounds
       while (size_up_reduce < max_reduce) {
-        // start position
         size_t start = size_up_reduce % buffer_size;
-        // peform read till end of buffer
         size_t nread = std::min(buffer_size - start,
                                 max_reduce - size_up_reduce);
-        utils::Assert(nread % type_nbytes == 0, "Allreduce: size check");
+        utils::Assert(nread % type_nbytes == 0, "Reduce: size check");
         for (int i = 0; i < nlink; ++i) {
-          if (i != parent_index) {
+          if (i != out_index) {
             reducer(links[i].buffer_head + start,
                     sendrecvbuf + size_up_reduce,
                     static_cast<int>(nread / type_nbytes),
-                    MPI::Datatype(type_nbytes));
+                    MPI::Datatype(type_nbytes, &wire_sum));
           }
         }
-        size_up_reduce += nread;
+        size_up_reduce += nread;
+      }
+    }
+    // pass the reduced data toward root
+    if (out_index != -1 && size_up_out < size_up_reduce) {
+      ssize_t len = links[out_index].sock.
+          Send(sendrecvbuf + size_up_out, size_up_reduce - size_up_out);
+      if (len != -1) {
+        size_up_out += static_cast<size_t>(len);
+      } else {
+        ReturnType ret = Errno2Return(errno);
+        if (ret != kSuccess) {
+          return ReportError(&links[out_index], ret);
+        }
+      }
+    }
+  }
+  return kSuccess;
+}
+// round size up to multiple of 8 bytes
+inline size_t Align8(size_t size) {
+  return (size + 7) / 8 * 8;
+}
+// whether a segment of len elements with nnz non-zero elements is encoded in dense format
+inline bool SparseUseDense(size_t nnz, size_t len, size_t type_nbytes) {
+  return Align8(sizeof(uint32_t) + nnz * sizeof(uint16_t)) + Align8(nnz * type_nbytes) >=
+      Align8(sizeof(uint32_t)) + Align8(len * type_nbytes);
+}
+/*!
+ * \brief encode data for sparse allreduce, each segment starts with the number of non-zero
+ *  elements, followed by either the dense values, or the offsets and values of non-zero elements,
+ *  every part is aligned to 8 bytes. The first 8 bytes store the size of the encoded data
+ * \param data the data to be encoded
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements in data
+ * \param segment number of elements in each segment
+ * \param p_out used to store the encoded data
+ * \return the size of encoded data in bytes
+ */
+inline size_t SparseEncode(const char *data, size_t type_nbytes, size_t count,
+                           size_t segment, std::vector<uint64_t> *p_out) {
+  std::vector<uint64_t> &out = *p_out;
+  std::vector<uint16_t> index;
+  out.resize(1);
+  for (size_t begin = 0; begin < count; begin += segment) {
+    const size_t len = std::min(segment, count - begin);
+    const char *seg = data + begin * type_nbytes;
+    index.clear();
+    for (size_t i = 0; i < len; ++i) {
+      const char *p = seg + i * type_nbytes;
+      for (size_t k = 0; k < type_nbytes; ++k) {
+        if (p[k] != 0) {
+          index.push_back(static_cast<uint16_t>(i)); break;
+        }
+      }
+    }
+    const uint32_t nnz = static_cast<uint32_t>(index.size());
+    const size_t pos = out.size() * sizeof(uint64_t);
+    if (SparseUseDense(nnz, len, type_nbytes)) {
+      const size_t nhead = Align8(sizeof(nnz));
+      out.resize(out.size() + (nhead + Align8(len * type_nbytes)) / sizeof(uint64_t));
+      char *p = reinterpret_cast<char*>(BeginPtr(out)) + pos;
+      std::memcpy(p, &nnz, sizeof(nnz));
+      std::memcpy(p + nhead, seg, len * type_nbytes);
+    } else {
+      const size_t nhead = Align8(sizeof(nnz) + nnz * sizeof(uint16_t));
+      out.resize(out.size() + (nhead + Align8(nnz * type_nbytes)) / sizeof(uint64_t));
+      char *p = reinterpret_cast<char*>(BeginPtr(out)) + pos;
+      std::memcpy(p, &nnz, sizeof(nnz));
+      for (size_t j = 0; j < nnz; ++j) {
+        std::memcpy(p + sizeof(nnz) + j * sizeof(uint16_t), &index[j], sizeof(uint16_t));
+      }
+      for (size_t j = 0; j < nnz; ++j) {
+        std::memcpy(p + nhead + j * type_nbytes,
+                    seg + index[j] * type_nbytes, type_nbytes);
+      }
+    }
+  }
+  out[0] = out.size() * sizeof(uint64_t);
+  return out.size() * sizeof(uint64_t);
+}
+/*!
+ * \brief decode data encoded by SparseEncode
+ * \param msg the encoded data, aligned to 8 bytes
+ * \param data the data to store the result
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements in data
+ * \param segment number of elements in each segment
+ * \param reducer if not NULL, the decoded data is reduced into data, otherwise data is overwritten
+ */
+inline void SparseDecode(const char *msg, char *data, size_t type_nbytes, size_t count,
+                         size_t segment, IEngine::ReduceFunction reducer) {
+  // temporal space to gather the elements that need to be reduced, aligned to 64 bits
+  std::vector<uint64_t> temp;
+  size_t pos = sizeof(uint64_t);
+  for (size_t begin = 0; begin < count; begin += segment) {
+    const size_t len = std::min(segment, count - begin);
+    char *seg = data + begin * type_nbytes;
+    uint32_t nnz;
+    std::memcpy(&nnz, msg + pos, sizeof(nnz));
+    if (SparseUseDense(nnz, len, type_nbytes)) {
+      const char *val = msg + pos + Align8(sizeof(nnz));
+      if (reducer != NULL) {
+        reducer(val, seg, static_cast<int>(len), MPI::Datatype(type_nbytes));
+      } else {
+        std::memcpy(seg, val, len * type_nbytes);
+      }
+      pos += Align8(sizeof(nnz)) + Align8(len * type_nbytes);
+    } else {
+      const uint16_t *index = reinterpret_cast<const uint16_t*>(msg + pos + sizeof(nnz));
+      const char *val = msg + pos + Align8(sizeof(nnz) + nnz * sizeof(uint16_t));
+      if (reducer != NULL) {
+        if (nnz != 0) {
+          temp.resize(Align8(nnz * type_nbytes) / sizeof(uint64_t));
+          char *tmp = reinterpret_cast<char*>(BeginPtr(temp));
+          for (size_t j = 0; j < nnz; ++j) {
+            std::memcpy(tmp + j * type_nbytes, seg + index[j] * type_nbytes, type_nbytes);
+          }
+          reducer(val, tmp, static_cast<int>(nnz), MPI::Datatype(type_nbytes));
+          for (size_t j = 0; j < nnz; ++j) {
+            std::memcpy(seg + index[j] * type_nbytes, tmp + j * type_nbytes, type_nbytes);
+          }
+        }
+      } else {
+        std::memset(seg, 0, len * type_nbytes);
+        for (size_t j = 0; j < nnz; ++j) {
+          std::memcpy(seg + index[j] * type_nbytes, val + j * type_nbytes, type_nbytes);
+        }
+      }
+      pos += Align8(sizeof(nnz) + nnz * sizeof(uint16_t)) + Align8(nnz * type_nbytes);
+    }
+  }
+  uint64_t size;
+  std::memcpy(&size, msg, sizeof(size));
+  utils::Assert(pos == size, "SparseAllreduce: size of encoded data inconsistent");
+}
+/*!
+ * \brief number of bytes of the encoded data to read, the encoded data starts with its size,
+ *  the buffer is resized to hold the data once the size is read
+ * \param msg the buffer of encoded data
+ * \param size_read number of bytes already read
+ */
+inline size_t SparseMessageSize(std::vector<uint64_t> *msg, size_t size_read) {
+  if (size_read < sizeof(uint64_t)) {
+    msg->resize(1);
+    return sizeof(uint64_t);
+  }
+  const uint64_t size = (*msg)[0];
+  utils::Check(size >= sizeof(size) && size % sizeof(uint64_t) == 0,
+               "SparseAllreduce: invalid size of encoded data");
+  msg->resize(size / sizeof(uint64_t));
+  return size;
+}
+/*!
+ * \brief whether all the encoded data is read
+ * \param msg the buffer of encoded data
+ * \param size_read number of bytes already read
+ */
+inline bool SparseMessageDone(const std::vector<uint64_t> &msg, size_t size_read) {
+  return size_read >= sizeof(uint64_t) && size_read == msg[0];
+}
+/*!
+ * \brief perform in-place allreduce of data that is mostly zero, on sendrecvbuf,
+ *  this function can fail, and will return the cause of failure
+ *
+ *  The data is divided into segments of rabit_sparse_segment elements, each segment
+ *  is encoded as offsets and values of its non-zero elements, or as dense values
+ *  when that is smaller. The encoded data of all the childs is read at the same time and
+ *  reduced up the tree, then the encoded result of the root is passed down the tree,
+ *  each node forwards it to its childs as it arrives.
+ *  Zero must be the identity of the reducer, as elements no node sets are not reduced.
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function, elements whose bytes are all zero must be identity of reducer
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TrySparseAllreduce(void *sendrecvbuf_,
+                                  size_t type_nbytes,
+                                  size_t count,
+                                  ReduceFunction reducer) {
+  RefLinkVector &links = tree_links;
+  if (links.size() == 0 || count == 0) return kSuccess;
+  // send recv buffer
+  char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  // number of links
+  const int nlink = static_cast<int>(links.size());
+  // the encoded data of each child, read from all the childs at the same time
+  std::vector< std::vector<uint64_t> > upmsg(nlink);
+  // the encoded data passed to parent, and the encoded result passed down
+  std::vector<uint64_t> msg, result;
+  // size of encoded data passed to parent, 0 until all the childs are reduced
+  size_t size_up = 0;
+  // the childs are decoded in the order of links, so the result does not depend on timing,
+  // this is the next link to be decoded
+  int next_decode = 0;
+  for (int i = 0; i < nlink; ++i) {
+    links[i].ResetSize();
+  }
+  // the root has the result after reduce, others get it from parent
+  LinkRecord *in_link = parent_index != -1 ? &links[parent_index] : NULL;
+  while (true) {
+    // decode the childs whose data is complete
+    while (next_decode < nlink) {
+      if (next_decode != parent_index) {
+        if (!SparseMessageDone(upmsg[next_decode], links[next_decode].size_read)) break;
+        SparseDecode(reinterpret_cast<char*>(BeginPtr(upmsg[next_decode])), sendrecvbuf,
+                     type_nbytes, count, sparse_segment, reducer);
+      }
+      ++next_decode;
+    }
+    if (next_decode == nlink && size_up == 0) {
+      size_up = SparseEncode(sendrecvbuf, type_nbytes, count, sparse_segment, &msg);
+      if (in_link == NULL) result = msg;
+    }
+    // size of the result, and the part of it available to pass down
+    size_t size_result = 0, size_down_in = 0;
+    if (in_link == NULL) {
+      size_result = size_down_in = size_up;
+    } else {
+      if (SparseMessageDone(result, in_link->size_read)) size_result = result[0];
+      size_down_in = in_link->size_read;
+    }
+    bool finished = size_result != 0;
+    utils::PollHelper &selecter = poller.Begin();
+    for (int i = 0; i < nlink; ++i) {
+      if (i == parent_index) {
+        if (size_result == 0) {
+          selecter.WatchRead(links[i].sock);
+          // only watch for exception in live channels
+          selecter.WatchException(links[i].sock);
+        }
+        if (size_up != 0 && links[i].size_write != size_up) {
+          selecter.WatchWrite(links[i].sock);
+          finished = false;
+        }
+      } else {
+        if (!SparseMessageDone(upmsg[i], links[i].size_read)) {
+          selecter.WatchRead(links[i].sock);
+        }
+        if (size_result == 0 || links[i].size_write != size_result) {
+          if (links[i].size_write < size_down_in) {
+            selecter.WatchWrite(links[i].sock);
+          }
+          // only watch for exception in live channels
+          selecter.WatchException(links[i].sock);
+          finished = false;
+        }
+      }
+    }
+    // finish runing allreduce
+    if (finished) break;
+    // select must return
+    selecter.Select();
+    // exception handling
+    for (int i = 0; i < nlink; ++i) {
+      // recive OOB message from some link
+      if (selecter.CheckExcept(links[i].sock)) {
+        return ReportError(&links[i], kGetExcept);
+      }
+    }
+    for (int i = 0; i < nlink; ++i) {
+      std::vector<uint64_t> &buf = i == parent_index ? result : upmsg[i];
+      if (selecter.CheckRead(links[i].sock) && !SparseMessageDone(buf, links[i].size_read)) {
+        // the buffer can be resized, take the pointer after it
+        const size_t size = SparseMessageSize(&buf, links[i].size_read);
+        ReturnType ret = links[i].ReadToArray(BeginPtr(buf), size);
+        if (ret != kSuccess) {
+          return ReportError(&links[i], ret);
+        }
+      }
+      if (!selecter.CheckWrite(links[i].sock)) continue;
+      ReturnType ret = kSuccess;
+      if (i == parent_index) {
+        // pass the reduced data up
+        if (size_up != 0 && links[i].size_write < size_up) {
+          ret = links[i].WriteFromArray(BeginPtr(msg), size_up);
+        }
+      } else if (links[i].size_write < size_down_in) {
+        // pass the result down as soon as it arrives
+        ret = links[i].WriteFromArray(BeginPtr(result), size_down_in);
+      }
+      if (ret != kSuccess) {
+        return ReportError(&links[i], ret);
+      }
+    }
+  }
+  if (in_link != NULL) {
+    SparseDecode(reinterpret_cast<char*>(BeginPtr(result)), sendrecvbuf,
+                 type_nbytes, count, sparse_segment, NULL);
+  }
+  return kSuccess;
+}
+/*!
+ * \brief perform in-place allreduce, on sendrecvbuf,
+ *  fast path for small messages along the reduction tree
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceSmall(void *sendrecvbuf_,
+                                 size_t type_nbytes,
+                                 size_t count,
+                                 ReduceFunction reducer) {
+  RefLinkVector &links = tree_links;
+  if (links.size() == 0 || count == 0) return kSuccess;
+  // total size of message
+  const size_t total_size = type_nbytes * count;
+  // number of links
+  const int nlink = static_cast<int>(links.size());
+  // size of slot for each link, aligned to 64 bits
+  const size_t slot_size = (total_size + 7) / 8 * 8;
+  utils::Assert(slot_size * nlink <= kSmallBufferSize,
+                "AllreduceSmall: message too large");
+  // send recv buffer
+  char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  // messages from childs, the message of link i is stored in slot i
+  uint64_t buffer[kSmallBufferSize / sizeof(uint64_t)];
+  char *recvbuf = reinterpret_cast<char*>(buffer);
+  // number of childs whose message is not yet received
+  int nwait = nlink - static_cast<int>(parent_index != -1);
+  for (int i = 0; i < nlink; ++i) {
+    links[i].ResetSize();
+  }
+  while (true) {
+    // try to make progress without select, messages are likely to be already there
+    for (int i = 0; i < nlink; ++i) {
+      if (i != parent_index && links[i].size_read != total_size) {
+        ReturnType ret = links[i].ReadToArray(recvbuf + i * slot_size, total_size);
+        if (ret != kSuccess) {
+          return ReportError(&links[i], ret);
+        }
+        if (links[i].size_read == total_size) {
+          reducer(recvbuf + i * slot_size, sendrecvbuf,
+                  static_cast<int>(count), MPI::Datatype(type_nbytes, &wire_sum));
+          --nwait;
+        }
       }
     }
-    if (parent_index != -1) {
-      // pass message up to parent, can pass data that are already been reduced
-      if (size_up_out < size_up_reduce) {
-        ssize_t len = links[parent_index].sock.
-            Send(sendrecvbuf + size_up_out, size_up_reduce - size_up_out);
-        if (len != -1) {
-          size_up_out += static_cast<size_t>(len);
-        } else {
-          ReturnType ret = Errno2Return(errno);
-          if (ret != kSuccess) {
-            return ReportError(&links[parent_index], ret);
-          }
+    if (nwait == 0 && parent_index != -1) {
+      LinkRecord &parent = links[parent_index];
+      // pass reduced message to parent, then get the result back
+      if (parent.size_write != total_size) {
+        ReturnType ret = parent.WriteFromArray(sendrecvbuf, total_size);
+        if (ret != kSuccess) {
+          return ReportError(&parent, ret);
         }
       }
-      // read data from parent
-      if (selecter.CheckRead(links[parent_index].sock) &&
-          total_size > size_down_in) {
-        ssize_t len = links[parent_index].sock.
-            Recv(sendrecvbuf + size_down_in, total_size - size_down_in);
-        if (len == 0) {
-          links[parent_index].sock.Close(); 
-          return ReportError(&links[parent_index], kRecvZeroLen);
+      if (parent.size_write == total_size && parent.size_read != total_size) {
+        ReturnType ret = parent.ReadToArray(sendrecvbuf, total_size);
+        if (ret != kSuccess) {
+          return ReportError(&parent, ret);
         }
-        if (len != -1) {
-          size_down_in += static_cast<size_t>(len);
-          utils::Assert(size_down_in <= size_up_out,
-                        "Allreduce: boundary error");
-        } else {
-          ReturnType ret = Errno2Return(errno);
+      }
+    }
+    // whether the final result is ready in sendrecvbuf
+    const bool have_result = nwait == 0 &&
+        (parent_index == -1 || links[parent_index].size_read == total_size);
+    bool finished = have_result;
+    if (have_result) {
+      // pass the result down to childs
+      for (int i = 0; i < nlink; ++i) {
+        if (i != parent_index && links[i].size_write != total_size) {
+          ReturnType ret = links[i].WriteFromArray(sendrecvbuf, total_size);
           if (ret != kSuccess) {
-            return ReportError(&links[parent_index], ret);
+            return ReportError(&links[i], ret);
           }
+          if (links[i].size_write != total_size) finished = false;
         }
       }
-    } else {
-      // this is root, can use reduce as most recent point
-      size_down_in = size_up_out = size_up_reduce;
     }
-    // can pass message down to childs
+    if (finished) break;
+    // no further progress can be made, wait for the links
+    utils::PollHelper &selecter = poller.Begin();
     for (int i = 0; i < nlink; ++i) {
-      if (i != parent_index && links[i].size_write < size_down_in) {
-        ReturnType ret = links[i].WriteFromArray(sendrecvbuf, size_down_in);
-        if (ret != kSuccess) {
-          return ReportError(&links[i], ret);
+      if (i == parent_index) {
+        if (nwait == 0) {
+          if (links[i].size_write != total_size) {
+            selecter.WatchWrite(links[i].sock);
+          } else {
+            selecter.WatchRead(links[i].sock);
+          }
+        }
+      } else {
+        if (links[i].size_read != total_size) {
+          selecter.WatchRead(links[i].sock);
+        }
+        if (have_result && links[i].size_write != total_size) {
+          selecter.WatchWrite(links[i].sock);
         }
       }
+      selecter.WatchException(links[i].sock);
+    }
+    selecter.Select();
+    for (int i = 0; i < nlink; ++i) {
+      // recive OOB message from some link
+      if (selecter.CheckExcept(links[i].sock)) {
+        return ReportError(&links[i], kGetExcept);
+      }
     }
   }
   return kSuccess;
@@ -499,6 +2123,86 @@ AllreduceBase::TryAllreduce(void *sendrecvbuf_,
  */
 AllreduceBase::ReturnType
 AllreduceBase::TryBroadcast(void *sendrecvbuf_, size_t total_size, int root) {
+  if (compress != 0 && total_size != 0 && total_size >= compress_min) {
+    return TryBroadcastCompressed(sendrecvbuf_, total_size, root);
+  }
+  return TryBroadcastRaw(sendrecvbuf_, total_size, root);
+}
+/*!
+ * \brief broadcast data from root to all nodes by the method decided from size of the data,
+ *  without the codec
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param total_size the size of the data to be broadcasted
+ * \param root the root worker id to broadcast the data
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryBroadcast
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryBroadcastRaw(void *sendrecvbuf_, size_t total_size, int root) {
+  int method = bcast_method;
+  if (method == kBcastAuto && !tune_table.empty()) {
+    method = tune_table.bcast[tune_table.Index(total_size)];
+  }
+  if (ring_prev == NULL || ring_next == NULL) method = kBcastTree;
+  if (method == kBcastAuto) {
+    if (total_size <= ring_threshold) {
+      method = kBcastTree;
+    } else if (total_size < bcast_segment * world_size) {
+      // the chain takes world_size steps to fill the pipeline,
+      // which is too much compared to the size of message
+      method = kBcastScatter;
+    } else {
+      method = kBcastChain;
+    }
+  }
+  switch (method) {
+    case kBcastChain: return TryBroadcastRing(sendrecvbuf_, total_size, root);
+    case kBcastScatter: return TryBroadcastScatter(sendrecvbuf_, total_size, root);
+    default: return TryBroadcastTree(sendrecvbuf_, total_size, root);
+  }
+}
+/*!
+ * \brief broadcast data from root to all nodes in the format of codec,
+ *  root first broadcasts the size of encoded data, which is 0 if the data is not compressible,
+ *  then the encoded data, or the data as it is
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param total_size the size of the data to be broadcasted
+ * \param root the root worker id to broadcast the data
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryBroadcast
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryBroadcastCompressed(void *sendrecvbuf_, size_t total_size, int root) {
+  std::string data;
+  uint64_t nbytes = 0;
+  if (rank == root) {
+    utils::CodecEncode(sendrecvbuf_, total_size, &data);
+    // not worth the time of encoding and decoding if less than 1/8 of bytes is saved
+    if (data.length() < total_size - total_size / 8) nbytes = data.length();
+  }
+  ReturnType ret = TryBroadcastRaw(&nbytes, sizeof(nbytes), root);
+  if (ret != kSuccess) return ret;
+  if (nbytes == 0) return TryBroadcastRaw(sendrecvbuf_, total_size, root);
+  data.resize(nbytes);
+  ret = TryBroadcastRaw(BeginPtr(data), data.length(), root);
+  if (ret != kSuccess) return ret;
+  if (rank != root) {
+    utils::Check(utils::CodecDecodedSize(BeginPtr(data), data.length()) == total_size,
+                 "Broadcast: size of compressed data inconsistent");
+    utils::CodecDecode(BeginPtr(data), data.length(), sendrecvbuf_);
+  }
+  return kSuccess;
+}
+/*!
+ * \brief broadcast data from root to all nodes by flooding over the tree
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param total_size the size of the data to be broadcasted
+ * \param root the root worker id to broadcast the data
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryBroadcast
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryBroadcastTree(void *sendrecvbuf_, size_t total_size, int root) {
   RefLinkVector &links = tree_links;
   if (links.size() == 0 || total_size == 0) return kSuccess;
   utils::Check(root < world_size,
@@ -523,7 +2227,7 @@ AllreduceBase::TryBroadcast(void *sendrecvbuf_, size_t total_size, int root) {
   while (true) {
     bool finished = true;
     // select helper
-    utils::SelectHelper selecter;
+    utils::PollHelper &selecter = poller.Begin();
     for (int i = 0; i < nlink; ++i) {
       if (in_link == -2) {
         selecter.WatchRead(links[i].sock); finished = false;
@@ -586,5 +2290,583 @@ AllreduceBase::TryBroadcast(void *sendrecvbuf_, size_t total_size, int root) {
   }
   return kSuccess;
 }
+/*!
+ * \brief broadcast data from root to all nodes along the ring,
+ *  the data is pipelined in segments through the chain root, root + 1, ..., root - 1
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param total_size the size of the data to be broadcasted
+ * \param root the root worker id to broadcast the data
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryBroadcast
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryBroadcastRing(void *sendrecvbuf_, size_t total_size, int root) {
+  if (total_size == 0) return kSuccess;
+  utils::Check(root < world_size,
+               "Broadcast: root should be smaller than world size");
+  // read from prev link and send to next one
+  LinkRecord &prev = *ring_prev, &next = *ring_next;
+  // the last node in the chain does not need to pass the data on
+  const bool forward = next.rank != root;
+  // size of data already read
+  size_t size_in = 0;
+  prev.ResetSize();
+  next.ResetSize();
+  if (this->rank == root) size_in = total_size;
+  while (true) {
+    bool finished = true;
+    // select helper
+    utils::PollHelper &selecter = poller.Begin();
+    if (size_in != total_size) {
+      selecter.WatchRead(prev.sock);
+      finished = false;
+    }
+    if (forward && next.size_write != total_size) {
+      if (next.size_write < size_in) {
+        selecter.WatchWrite(next.sock);
+      }
+      finished = false;
+    }
+    if (finished) break;
+    selecter.WatchException(prev.sock);
+    selecter.WatchException(next.sock);
+    selecter.Select();
+    if (selecter.CheckExcept(prev.sock)) return ReportError(&prev, kGetExcept);
+    if (selecter.CheckExcept(next.sock)) return ReportError(&next, kGetExcept);
+    // read at most one segment at a time, so that it can be passed on early
+    if (size_in != total_size && selecter.CheckRead(prev.sock)) {
+      ReturnType ret = prev.ReadToArray(sendrecvbuf_,
+                                        std::min(total_size, size_in + bcast_segment));
+      if (ret != kSuccess) {
+        return ReportError(&prev, ret);
+      }
+      size_in = prev.size_read;
+    }
+    if (forward && next.size_write < size_in) {
+      ReturnType ret = next.WriteFromArray(sendrecvbuf_,
+                                           std::min(size_in, next.size_write + bcast_segment));
+      if (ret != kSuccess) {
+        return ReportError(&next, ret);
+      }
+    }
+  }
+  return kSuccess;
+}
+/*!
+ * \brief broadcast data from root to all nodes by scatter followed by ring allgather
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param total_size the size of the data to be broadcasted
+ * \param root the root worker id to broadcast the data
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryBroadcast
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryBroadcastScatter(void *sendrecvbuf_, size_t total_size, int root) {
+  if (total_size == 0) return kSuccess;
+  utils::Check(root < world_size,
+               "Broadcast: root should be smaller than world size");
+  // read from prev link and send to next one
+  LinkRecord &prev = *ring_prev, &next = *ring_next;
+  char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  const size_t n = static_cast<size_t>(world_size);
+  const size_t step = (total_size + n - 1) / n;
+  const size_t r = static_cast<size_t>(rank);
+  // slice k covers [min(k * step, total_size), min((k + 1) * step, total_size))
+  const size_t begin = std::min(r * step, total_size);
+  const size_t end = std::min((r + 1) * step, total_size);
+  const size_t pr = (r + n - 1) % n;
+  const size_t size_prev_slice =
+      std::min((pr + 1) * step, total_size) - std::min(pr * step, total_size);
+  // scatter: root passes slices root + 1, ..., root - 1 to next,
+  // node r gets slices r, ..., root - 1 from prev, keeps slice r and passes on the rest.
+  // all the pointers are logical positions starting from begin,
+  // position p maps to p % total_size in sendrecvbuf
+  size_t stop_read = begin;
+  for (size_t k = r; k != static_cast<size_t>(root); k = (k + 1) % n) {
+    stop_read += std::min((k + 1) * step, total_size) - std::min(k * step, total_size);
+  }
+  if (rank == root) stop_read = begin + total_size;
+  const size_t stop_write = next.rank == root ? end : stop_read;
+  size_t read_ptr = rank == root ? stop_read : begin;
+  size_t write_ptr = end;
+  while (true) {
+    bool finished = true;
+    // select helper
+    utils::PollHelper &selecter = poller.Begin();
+    if (read_ptr != stop_read) {
+      selecter.WatchRead(prev.sock);
+      finished = false;
+    }
+    if (write_ptr < stop_write) {
+      if (write_ptr < read_ptr) {
+        selecter.WatchWrite(next.sock);
+      }
+      finished = false;
+    }
+    if (finished) break;
+    selecter.WatchException(prev.sock);
+    selecter.WatchException(next.sock);
+    selecter.Select();
+    if (selecter.CheckExcept(prev.sock)) return ReportError(&prev, kGetExcept);
+    if (selecter.CheckExcept(next.sock)) return ReportError(&next, kGetExcept);
+    if (read_ptr != stop_read && selecter.CheckRead(prev.sock)) {
+      size_t size = stop_read - read_ptr;
+      size_t start = read_ptr % total_size;
+      if (start + size > total_size) {
+        size = total_size - start;
+      }
+      ssize_t len = prev.sock.Recv(sendrecvbuf + start, size);
+      if (len == 0) {
+        prev.sock.Close(); return ReportError(&prev, kRecvZeroLen);
+      }
+      if (len != -1) {
+        read_ptr += static_cast<size_t>(len);
+      } else {
+        ReturnType ret = Errno2Return(errno);
+        if (ret != kSuccess) return ReportError(&prev, ret);
+      }
+    }
+    if (write_ptr < read_ptr && write_ptr < stop_write) {
+      size_t size = std::min(read_ptr, stop_write) - write_ptr;
+      size_t start = write_ptr % total_size;
+      if (start + size > total_size) {
+        size = total_size - start;
+      }
+      ssize_t len = next.sock.Send(sendrecvbuf + start, size);
+      if (len != -1) {
+        write_ptr += static_cast<size_t>(len);
+      } else {
+        ReturnType ret = Errno2Return(errno);
+        if (ret != kSuccess) return ReportError(&next, ret);
+      }
+    }
+  }
+  // allgather the slices along the ring
+  return TryAllgatherRing(sendrecvbuf_, total_size, begin, end, size_prev_slice);
+}
+/*!
+ * \brief perform in-place allgather along the ring,
+ *  each node owns a slice of sendrecvbuf, the slices are ordered by rank,
+ *  after the call, the entire sendrecvbuf is filled with data of all nodes
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param total_size total size of data in bytes
+ * \param slice_begin beginning of the slice owned by current node
+ * \param slice_end end of the slice owned by current node
+ * \param size_prev_slice size of the slice owned by the previous node in the ring
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllgatherRing(void *sendrecvbuf_, size_t total_size,
+                                size_t slice_begin,
+                                size_t slice_end,
+                                size_t size_prev_slice) {
+  // read from next link and send to prev one
+  LinkRecord &prev = *ring_prev, &next = *ring_next;
+  // need to reply on special rank structure
+  utils::Assert(next.rank == (rank + 1) % world_size &&
+                rank == (prev.rank + 1) % world_size,
+                "need to assume rank structure");
+  // send recv buffer
+  char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  // all the pointers are logical positions starting from slice_begin,
+  // position p maps to p % total_size in sendrecvbuf
+  const size_t stop_read = total_size + slice_begin;
+  const size_t stop_write = total_size + slice_begin - size_prev_slice;
+  size_t write_ptr = slice_begin;
+  size_t read_ptr = slice_end;
+
+  while (true) {
+    // select helper
+    bool finished = true;
+    utils::PollHelper &selecter = poller.Begin();
+    if (read_ptr != stop_read) {
+      selecter.WatchRead(next.sock);
+      finished = false;
+    }
+    if (write_ptr != stop_write) {
+      if (write_ptr < read_ptr) {
+        selecter.WatchWrite(prev.sock);
+      }
+      finished = false;
+    }
+    if (finished) break;
+    selecter.WatchException(prev.sock);
+    selecter.WatchException(next.sock);
+    selecter.Select();
+    if (selecter.CheckExcept(prev.sock)) return ReportError(&prev, kGetExcept);
+    if (selecter.CheckExcept(next.sock)) return ReportError(&next, kGetExcept);
+    // read data from next link
+    if (read_ptr != stop_read && selecter.CheckRead(next.sock)) {
+      size_t size = stop_read - read_ptr;
+      size_t start = read_ptr % total_size;
+      if (start + size > total_size) {
+        size = total_size - start;
+      }
+      ssize_t len = next.sock.Recv(sendrecvbuf + start, size);
+      if (len == 0) {
+        next.sock.Close(); return ReportError(&next, kRecvZeroLen);
+      }
+      if (len != -1) {
+        read_ptr += static_cast<size_t>(len);
+      } else {
+        ReturnType ret = Errno2Return(errno);
+        if (ret != kSuccess) return ReportError(&next, ret);
+      }
+    }
+    // pass the data we already have to prev link
+    if (write_ptr < read_ptr && write_ptr != stop_write) {
+      size_t size = std::min(read_ptr, stop_write) - write_ptr;
+      size_t start = write_ptr % total_size;
+      if (start + size > total_size) {
+        size = total_size - start;
+      }
+      ssize_t len = prev.sock.Send(sendrecvbuf + start, size);
+      if (len != -1) {
+        write_ptr += static_cast<size_t>(len);
+      } else {
+        ReturnType ret = Errno2Return(errno);
+        if (ret != kSuccess) return ReportError(&prev, ret);
+      }
+    }
+  }
+  return kSuccess;
+}
+/*!
+ * \brief perform in-place reduce-scatter, on sendrecvbuf, this function can fail,
+ *  and will return the cause of failure
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param counts number of elements in the block of each node
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryReduceScatter(void *sendrecvbuf_,
+                                size_t type_nbytes,
+                                const std::vector<size_t> &counts,
+                                ReduceFunction reducer) {
+  utils::Check(counts.size() == static_cast<size_t>(GetWorldSize()),
+               "ReduceScatter: size of counts must equal world size");
+  if (ring_prev == NULL || ring_next == NULL) return kSuccess;
+  std::vector<size_t> slice_ptr(1, 0);
+  for (size_t i = 0; i < counts.size(); ++i) {
+    slice_ptr.push_back(slice_ptr.back() + counts[i]);
+  }
+  if (slice_ptr.back() == 0) return kSuccess;
+  return TryReduceScatterRing(sendrecvbuf_, type_nbytes, slice_ptr, reducer);
+}
+/*!
+ * \brief perform in-place allgather, on sendrecvbuf, this function can fail,
+ *  and will return the cause of failure
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param sizes size of the block of each node in bytes
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllgather(void *sendrecvbuf_, const std::vector<size_t> &sizes) {
+  utils::Check(sizes.size() == static_cast<size_t>(GetWorldSize()),
+               "Allgather: size of sizes must equal world size");
+  if (ring_prev == NULL || ring_next == NULL) return kSuccess;
+  size_t total_size = 0, begin = 0;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    if (i == static_cast<size_t>(rank)) begin = total_size;
+    total_size += sizes[i];
+  }
+  if (total_size == 0) return kSuccess;
+  return TryAllgatherRing(sendrecvbuf_, total_size, begin, begin + sizes[rank],
+                          sizes[(rank + world_size - 1) % world_size]);
+}
+/*!
+ * \brief perform in-place reduce-scatter along the ring,
+ *  the data is divided into world_size slices, slice k covers elements [slice_ptr[k], slice_ptr[k + 1]),
+ *  after the call, slice r of sendrecvbuf in node r contains the reduced result of the slice
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param slice_ptr the beginning of each slice, in number of elements, size equals world_size + 1
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryReduceScatterRing(void *sendrecvbuf_,
+                                    size_t type_nbytes,
+                                    const std::vector<size_t> &slice_ptr,
+                                    ReduceFunction reducer) {
+  // read from next link and send to prev one
+  LinkRecord &prev = *ring_prev, &next = *ring_next;
+  // need to reply on special rank structure
+  utils::Assert(next.rank == (rank + 1) % world_size &&
+                rank == (prev.rank + 1) % world_size,
+                "need to assume rank structure");
+  const size_t n = static_cast<size_t>(world_size);
+  utils::Assert(slice_ptr.size() == n + 1, "ReduceScatter: slice_ptr size check");
+  // total size of message
+  const size_t total_size = type_nbytes * slice_ptr[n];
+  const size_t r = static_cast<size_t>(rank);
+  // maximum size of slice, used to decide size of ring buffer
+  size_t max_slice = 1;
+  for (size_t k = 0; k < n; ++k) {
+    max_slice = std::max(max_slice, slice_ptr[k + 1] - slice_ptr[k]);
+  }
+  // the slices are passed backward along the ring:
+  // we send slices r+1, ..., r+n-1 to prev, and receive slices r+2, ..., r+n from next,
+  // slice r is received last, and holds the final result after reduction
+  const size_t write_begin = slice_ptr[(r + 1) % n] * type_nbytes;
+  const size_t write_end = slice_ptr[(r + 1) % n + 1] * type_nbytes;
+  const size_t slice_size = (slice_ptr[r + 1] - slice_ptr[r]) * type_nbytes;
+  // all the pointers are logical positions starting from write_begin,
+  // position p maps to p % total_size in sendrecvbuf
+  const size_t stop_read = total_size + write_begin;
+  const size_t stop_write = total_size + write_begin - slice_size;
+  // send recv buffer
+  char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  size_t write_ptr = write_begin;
+  size_t reduce_ptr = write_end;
+  // use ring buffer in next position
+  next.InitBuffer(type_nbytes, max_slice, reduce_buffer_size);
+  next.ResetSize();
+  next.size_read = write_end;
+  // the first slice is sent out directly, reduce the rest of slices as they arrive
+  while (true) {
+    // select helper
+    bool finished = true;
+    utils::PollHelper &selecter = poller.Begin();
+    if (next.size_read != stop_read) {
+      selecter.WatchRead(next.sock);
+      finished = false;
+    }
+    if (write_ptr != stop_write) {
+      if (write_ptr < reduce_ptr) {
+        selecter.WatchWrite(prev.sock);
+      }
+      finished = false;
+    }
+    if (finished) break;
+    selecter.WatchException(prev.sock);
+    selecter.WatchException(next.sock);
+    selecter.Select();
+    if (selecter.CheckExcept(prev.sock)) return ReportError(&prev, kGetExcept);
+    if (selecter.CheckExcept(next.sock)) return ReportError(&next, kGetExcept);
+    // read data from next link
+    if (next.size_read != stop_read && selecter.CheckRead(next.sock)) {
+      // never read beyond stop_read, the rest belongs to the allgather
+      ReturnType ret = next.ReadToRingBuffer(reduce_ptr, stop_read);
+      if (ret != kSuccess) {
+        return ReportError(&next, ret);
+      }
+      const size_t buffer_size = next.buffer_size;
+      // round to type_nbytes, all the slices start at multiples of type_nbytes
+      const size_t max_reduce = next.size_read / type_nbytes * type_nbytes;
+      // peform reduce, can be at most two rounds in each segment of buffer
+      while (reduce_ptr < max_reduce) {
+        size_t bstart = reduce_ptr % buffer_size;
+        size_t nread = std::min(buffer_size - bstart,
+                                max_reduce - reduce_ptr);
+        size_t rstart = reduce_ptr % total_size;
+        nread = std::min(nread, total_size - rstart);
+        reducer(next.buffer_head + bstart,
+                sendrecvbuf + rstart,
+                static_cast<int>(nread / type_nbytes),
+                MPI::Datatype(type_nbytes, &wire_sum));
+        reduce_ptr += nread;
+      }
+    }
+    // pass the reduced data to prev link
+    if (write_ptr < reduce_ptr && write_ptr != stop_write) {
+      size_t size = std::min(reduce_ptr, stop_write) - write_ptr;
+      size_t start = write_ptr % total_size;
+      if (start + size > total_size) {
+        size = total_size - start;
+      }
+      ssize_t len = prev.sock.Send(sendrecvbuf + start, size);
+      if (len != -1) {
+        write_ptr += static_cast<size_t>(len);
+      } else {
+        ReturnType ret = Errno2Return(errno);
+        if (ret != kSuccess) return ReportError(&prev, ret);
+      }
+    }
+  }
+  return kSuccess;
+}
+/*!
+ * \brief perform in-place allreduce, on sendrecvbuf,
+ *  using ring-based reduce-scatter followed by allgather,
+ *  every node sends and receives about 2 * total_size bytes regardless of world size,
+ *  which is the bandwidth optimal method for large messages
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceRing(void *sendrecvbuf_,
+                                size_t type_nbytes,
+                                size_t count,
+                                ReduceFunction reducer) {
+  const size_t n = static_cast<size_t>(world_size);
+  const size_t step = (count + n - 1) / n;
+  // slice k covers [min(k * step, count), min((k + 1) * step, count))
+  std::vector<size_t> slice_ptr(n + 1);
+  for (size_t k = 0; k <= n; ++k) {
+    slice_ptr[k] = std::min(k * step, count);
+  }
+  ReturnType ret = TryReduceScatterRing(sendrecvbuf_, type_nbytes, slice_ptr, reducer);
+  if (ret != kSuccess) return ret;
+  const size_t r = static_cast<size_t>(rank);
+  // previous rank
+  const size_t pr = (r + n - 1) % n;
+  return TryAllgatherRing(sendrecvbuf_, type_nbytes * count,
+                          slice_ptr[r] * type_nbytes,
+                          slice_ptr[r + 1] * type_nbytes,
+                          (slice_ptr[pr + 1] - slice_ptr[pr]) * type_nbytes);
+}
+/*!
+ * \brief send and receive data with a peer at the same time
+ * \param link the link to the peer
+ * \param sendbuf_ buffer of data to be sent
+ * \param send_size size of data to be sent
+ * \param recvbuf_ buffer to store the received data
+ * \param recv_size size of data to be received
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryExchange(LinkRecord *link,
+                           const void *sendbuf_, size_t send_size,
+                           void *recvbuf_, size_t recv_size) {
+  link->ResetSize();
+  while (link->size_write != send_size || link->size_read != recv_size) {
+    utils::PollHelper &selecter = poller.Begin();
+    if (link->size_write != send_size) selecter.WatchWrite(link->sock);
+    if (link->size_read != recv_size) selecter.WatchRead(link->sock);
+    selecter.WatchException(link->sock);
+    selecter.Select();
+    if (selecter.CheckExcept(link->sock)) {
+      return ReportError(link, kGetExcept);
+    }
+    if (link->size_read != recv_size && selecter.CheckRead(link->sock)) {
+      ReturnType ret = link->ReadToArray(recvbuf_, recv_size);
+      if (ret != kSuccess) return ReportError(link, ret);
+    }
+    if (link->size_write != send_size && selecter.CheckWrite(link->sock)) {
+      ReturnType ret = link->WriteFromArray(sendbuf_, send_size);
+      if (ret != kSuccess) return ReportError(link, ret);
+    }
+  }
+  return kSuccess;
+}
+/*!
+ * \brief perform in-place allreduce, on sendrecvbuf,
+ *  using recursive halving reduce-scatter followed by recursive doubling allgather
+ *
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+ * \sa ReturnType, TryAllreduce
+ */
+AllreduceBase::ReturnType
+AllreduceBase::TryAllreduceHalvingDoubling(void *sendrecvbuf_,
+                                           size_t type_nbytes,
+                                           size_t count,
+                                           ReduceFunction reducer) {
+  RefLinkVector &links = hd_links;
+  if (links.size() == 0 || count == 0) return kSuccess;
+  // total size of message
+  const size_t total_size = type_nbytes * count;
+  // send recv buffer
+  char *sendrecvbuf = reinterpret_cast<char*>(sendrecvbuf_);
+  // largest power of 2 that is no larger than world size
+  int nproc = 1, nround = 0;
+  while (nproc * 2 <= world_size) {
+    nproc *= 2; ++nround;
+  }
+  // number of extra nodes that need to be paired up
+  const int nextra = world_size - nproc;
+  // index of the link to be used next
+  size_t ilink = 0;
+  // rank among the nodes that run recursive halving and doubling
+  int vrank;
+  // buffer to store the data from peer, aligned to 64 bits
+  std::vector<uint64_t> temp((total_size + 7) / 8);
+  char *tempbuf = reinterpret_cast<char*>(BeginPtr(temp));
+  ReturnType ret;
+  if (rank < 2 * nextra) {
+    if (rank % 2 == 0) {
+      // extra node, pass data to the partner and wait for the result
+      ret = TryExchange(&links[0], sendrecvbuf, total_size, NULL, 0);
+      if (ret != kSuccess) return ret;
+      return TryExchange(&links[0], NULL, 0, sendrecvbuf, total_size);
+    }
+    ret = TryExchange(&links[0], NULL, 0, tempbuf, total_size);
+    if (ret != kSuccess) return ret;
+    reducer(tempbuf, sendrecvbuf, static_cast<int>(count),
+            MPI::Datatype(type_nbytes, &wire_sum));
+    vrank = rank / 2;
+    ilink = 1;
+  } else {
+    vrank = rank - nextra;
+  }
+  utils::Assert(links.size() - ilink == static_cast<size_t>(nround),
+                "HalvingDoubling: number of links inconsistent with world size");
+  // range of elements in charge, recorded for each round to be reused in doubling
+  size_t begin = 0, end = count;
+  std::vector<std::pair<size_t, size_t> > ranges;
+  // recursive halving: keep half of the range, pass the other half to the partner
+  for (int mask = nproc / 2; mask >= 1; mask /= 2, ++ilink) {
+    const size_t mid = begin + (end - begin) / 2;
+    ranges.push_back(std::make_pair(begin, end));
+    size_t sbegin, send, rbegin, rend;
+    if ((vrank & mask) == 0) {
+      sbegin = mid; send = end; rbegin = begin; rend = mid;
+    } else {
+      sbegin = begin; send = mid; rbegin = mid; rend = end;
+    }
+    ret = TryExchange(&links[ilink],
+                      sendrecvbuf + sbegin * type_nbytes, (send - sbegin) * type_nbytes,
+                      tempbuf, (rend - rbegin) * type_nbytes);
+    if (ret != kSuccess) return ret;
+    if (rend != rbegin) {
+      reducer(tempbuf, sendrecvbuf + rbegin * type_nbytes,
+              static_cast<int>(rend - rbegin), MPI::Datatype(type_nbytes, &wire_sum));
+    }
+    begin = rbegin; end = rend;
+  }
+  // recursive doubling: exchange the reduced range with the partner of each round in reverse order
+  for (int mask = 1; mask < nproc; mask *= 2) {
+    --ilink;
+    const size_t pbegin = ranges.back().first, pend = ranges.back().second;
+    ranges.pop_back();
+    size_t rbegin, rend;
+    if ((vrank & mask) == 0) {
+      rbegin = end; rend = pend;
+    } else {
+      rbegin = pbegin; rend = begin;
+    }
+    ret = TryExchange(&links[ilink],
+                      sendrecvbuf + begin * type_nbytes, (end - begin) * type_nbytes,
+                      sendrecvbuf + rbegin * type_nbytes, (rend - rbegin) * type_nbytes);
+    if (ret != kSuccess) return ret;
+    begin = pbegin; end = pend;
+  }
+  // pass the result back to the extra node
+  if (rank < 2 * nextra) {
+    ret = TryExchange(&links[0], sendrecvbuf, total_size, NULL, 0);
+    if (ret != kSuccess) return ret;
+  }
+  return kSuccess;
+}
 }  // namespace engine
 }  // namespace rabit
@@ -18,22 +18,42 @@
 #include "../include/rabit/utils.h"
 #include "../include/rabit/engine.h"
 #include "./socket.h"
+#include "./uring.h"
+#include "./half.h"
 
 namespace MPI {
 // MPI data type to be compatible with existing MPI interface
 class Datatype {
  public:
   size_t type_size;
-  explicit Datatype(size_t type_size) : type_size(type_size) {}
+  // state of the reduce function kept by the engine, reduce functions of user ignore it
+  void *state;
+  explicit Datatype(size_t type_size, void *state = NULL)
+      : type_size(type_size), state(state) {}
 };
 }
 namespace rabit {
 namespace engine {
+/*!
+ * \brief state of float sum allreduce passed in 16 bit on the wire, see AllreduceSumFloat,
+ *  each node keeps the partial sum of its elements in float, only the bytes sent are rounded
+ */
+struct WireSum {
+  /*! \brief float data of user, NULL when no such allreduce is running */
+  const float *data;
+  /*! \brief the buffer in 16 bit being reduced in this try */
+  const uint16_t *wire;
+  /*! \brief partial sum of each element of wire */
+  std::vector<float> acc;
+  WireSum(void) : data(NULL), wire(NULL) {}
+};
 /*! \brief implementation of basic Allreduce engine */
 class AllreduceBase : public IEngine {
  public:
   // magic number to verify server
   static const int kMagic = 0xff99;
+  // size of stack buffer used by small message allreduce, in bytes
+  static const size_t kSmallBufferSize = 32UL << 10UL;
   // constant one byte out of band message to indicate error happening
   AllreduceBase(void);
   virtual ~AllreduceBase(void) {}
@@ -86,10 +106,72 @@ class AllreduceBase : public IEngine {
                          PreprocFunction prepare_fun = NULL,
                          void *prepare_arg = NULL) {
     if (prepare_fun != NULL) prepare_fun(prepare_arg);
-    utils::Assert(TryAllreduce(sendrecvbuf_,
-                               type_nbytes, count, reducer) == kSuccess,
+    utils::Assert(TryAllreduceData(sendrecvbuf_,
+                                   type_nbytes, count, reducer) == kSuccess,
                   "Allreduce failed");
   }
+  /*!
+   * \brief perform in-place allreduce of float sum, the data can be passed in 16 bit
+   *  floating point on the wire to halve the bytes sent, see rabit_wire_dtype
+   * \param sendrecvbuf buffer for both sending and recving data
+   * \param count number of elements to be reduced
+   * \param reducer reduce function of float sum, used when data is passed in 32 bit
+   * \param prepare_fun Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Allreduce, to intialize the data in sendrecvbuf_.
+   *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to passed into the lazy preprocessing function
+   */
+  void AllreduceSumFloat(float *sendrecvbuf,
+                         size_t count,
+                         ReduceFunction reducer,
+                         PreprocFunction prepare_fun = NULL,
+                         void *prepare_arg = NULL);
+  /*!
+   * \brief perform in-place allreduce of data that is mostly zero, on sendrecvbuf
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Allreduce
+   * \param prepare_arg argument used to passed into the lazy preprocessing function
+   */
+  virtual void SparseAllreduce(void *sendrecvbuf_,
+                               size_t type_nbytes,
+                               size_t count,
+                               ReduceFunction reducer,
+                               PreprocFunction prepare_fun = NULL,
+                               void *prepare_arg = NULL) {
+    if (prepare_fun != NULL) prepare_fun(prepare_arg);
+    utils::Assert(TrySparseAllreduce(sendrecvbuf_,
+                                     type_nbytes, count, reducer) == kSuccess,
+                  "SparseAllreduce failed");
+  }
+  /*!
+   * \brief perform in-place reduce, on sendrecvbuf, only root gets the result
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \param root the root worker id to get the result
+   * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Reduce
+   * \param prepare_arg argument used to passed into the lazy preprocessing function
+   */
+  virtual void Reduce(void *sendrecvbuf_,
+                      size_t type_nbytes,
+                      size_t count,
+                      ReduceFunction reducer,
+                      int root,
+                      PreprocFunction prepare_fun = NULL,
+                      void *prepare_arg = NULL) {
+    if (prepare_fun != NULL) prepare_fun(prepare_arg);
+    utils::Assert(TryReduce(sendrecvbuf_,
+                            type_nbytes, count, reducer, root) == kSuccess,
+                  "Reduce failed");
+  }
   /*!
    * \brief broadcast data from root to all nodes
    * \param sendrecvbuf_ buffer for both sending and recving data
@@ -100,6 +182,48 @@ class AllreduceBase : public IEngine {
     utils::Assert(TryBroadcast(sendrecvbuf_, total_size, root) == kSuccess,
                   "Broadcast failed");
   }
+  /*!
+   * \brief perform in-place reduce-scatter, on sendrecvbuf
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param counts number of elements in the block of each node
+   * \param reducer reduce function
+   * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+   *                     will be called by the function before performing ReduceScatter
+   * \param prepare_arg argument used to passed into the lazy preprocessing function
+   */
+  virtual void ReduceScatter(void *sendrecvbuf_,
+                             size_t type_nbytes,
+                             const std::vector<size_t> &counts,
+                             ReduceFunction reducer,
+                             PreprocFunction prepare_fun = NULL,
+                             void *prepare_arg = NULL) {
+    if (prepare_fun != NULL) prepare_fun(prepare_arg);
+    utils::Assert(TryReduceScatter(sendrecvbuf_,
+                                   type_nbytes, counts, reducer) == kSuccess,
+                  "ReduceScatter failed");
+  }
+  /*!
+   * \brief perform in-place allgather, on sendrecvbuf
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param size the size of the block of each node in bytes
+   */
+  virtual void Allgather(void *sendrecvbuf_, size_t size) {
+    std::vector<size_t> sizes(GetWorldSize(), size);
+    this->Allgatherv(sendrecvbuf_, sizes);
+  }
+  /*!
+   * \brief perform in-place allgather of blocks with different size, on sendrecvbuf
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param sizes size of the block of each node in bytes
+   */
+  virtual void Allgatherv(void *sendrecvbuf_, const std::vector<size_t> &sizes) {
+    utils::Assert(TryAllgather(sendrecvbuf_, sizes) == kSuccess,
+                  "Allgather failed");
+  }
   /*!
    * \brief load latest check point
    * \param global_model pointer to the globally shared model/state
@@ -197,6 +321,32 @@ class AllreduceBase : public IEngine {
   }
 
  protected:
+  /*! \brief methods of broadcast */
+  enum BroadcastMethod {
+    /*! \brief choose the method by size of message */
+    kBcastAuto,
+    /*! \brief flooding over the tree */
+    kBcastTree,
+    /*! \brief pipelined chain along the ring */
+    kBcastChain,
+    /*! \brief scatter followed by ring allgather */
+    kBcastScatter
+  };
+  /*! \brief methods of allreduce that can be chosen by auto tuning */
+  enum AllreduceMethod {
+    /*! \brief reduce and broadcast along the tree */
+    kAllreduceTree,
+    /*! \brief half of the message along each tree of double binary tree */
+    kAllreduceDoubleTree,
+    /*! \brief recursive halving and doubling */
+    kAllreduceHalvingDoubling,
+    /*! \brief reduce-scatter and allgather along the ring */
+    kAllreduceRing,
+    /*! \brief through the leaders of each host */
+    kAllreduceHierarchical,
+    /*! \brief number of methods */
+    kNumAllreduceMethod
+  };
   /*! \brief enumeration of possible returning results from Try functions */
   enum ReturnTypeEnum {
     /*! \brief execution is successful */
@@ -236,8 +386,8 @@ class AllreduceBase : public IEngine {
   // link record to a neighbor
   struct LinkRecord {
    public:
-    // socket to get data from/to link
-    utils::TCPSocket sock;
+    // socket to get data from/to link, can pass data through shared memory
+    utils::LinkSocket sock;
     // rank of the node in this link
     int rank;
     // size of data readed from link
@@ -275,14 +425,17 @@ class AllreduceBase : public IEngine {
      *  position after protect_start
      * \param protect_start all data start from protect_start is still needed in buffer
      *                      read shall not override this 
+     * \param max_size_read maximum logical amount we can read, size_read cannot exceed this value
      * \return the type of reading
      */
-    inline ReturnType ReadToRingBuffer(size_t protect_start) {
+    inline ReturnType ReadToRingBuffer(size_t protect_start, size_t max_size_read) {
       utils::Assert(buffer_head != NULL, "ReadToRingBuffer: buffer not allocated");
+      utils::Assert(size_read <= max_size_read, "ReadToRingBuffer: max_size_read check");
       size_t ngap = size_read - protect_start;
       utils::Assert(ngap <= buffer_size, "Allreduce: boundary check");
       size_t offset = size_read % buffer_size;
       size_t nmax = std::min(buffer_size - ngap, buffer_size - offset);
+      nmax = std::min(nmax, max_size_read - size_read);
       if (nmax == 0) return kSuccess;
       ssize_t len = sock.Recv(buffer_head + offset, nmax);
       // length equals 0, remote disconnected
@@ -344,6 +497,59 @@ class AllreduceBase : public IEngine {
       return plinks.size();
     }
   };
+  /*!
+   * \brief state of allreduce along one reduction tree,
+   *  several trees can run concurrently over different links, see TryAllreduceTreeTasks
+   */
+  struct TreeTask {
+    // links of the tree, and index of parent link, -1 for root
+    RefLinkVector *links;
+    int parent_index;
+    // part of sendrecvbuf reduced by this tree
+    char *sendrecvbuf;
+    // total size of the part in bytes
+    size_t total_size;
+    // size of space that we already performs reduce in up pass
+    size_t size_up_reduce;
+    // size of space that we have already passed to parent
+    size_t size_up_out;
+    // size of message we received, and send in the down pass
+    size_t size_down_in;
+  };
+  /*!
+   * \brief table of auto tuning, gives the methods of allreduce and broadcast
+   *  for messages of different size, it is the same in all the nodes
+   */
+  struct TuneTable {
+    // message sizes in increasing order, an entry is used for messages no larger than its size,
+    // the last entry is also used for larger messages
+    std::vector<size_t> size;
+    // method of allreduce of each entry, see AllreduceMethod
+    std::vector<int> allreduce;
+    // method of broadcast of each entry, see BroadcastMethod
+    std::vector<int> bcast;
+    /*! \return whether the table is empty, in which case the methods are chosen by the thresholds */
+    inline bool empty(void) const {
+      return size.size() == 0;
+    }
+    /*! \return index of entry used for message of total_size */
+    inline size_t Index(size_t total_size) const {
+      size_t i = std::lower_bound(size.begin(), size.end(), total_size) - size.begin();
+      return std::min(i, size.size() - 1);
+    }
+    /*!
+     * \brief load the table from text
+     * \param text the text given by Str
+     * \param world_size the table is only valid for the world size it is calibrated for
+     * \return whether the text is a valid table
+     */
+    bool Load(const std::string &text, int world_size);
+    /*!
+     * \brief save the table in text, which can be edited by hand
+     * \param world_size world size the table is calibrated for
+     */
+    std::string Str(int world_size) const;
+  };
   /*!
    * \brief initialize connection to the tracker
    * \return a socket that initializes the connection
@@ -355,6 +561,70 @@ class AllreduceBase : public IEngine {
    * \param cmd possible command to sent to tracker
    */
   void ReConnectLinks(const char *cmd = "start");
+  /*!
+   * \brief setup shared memory channel of new links to the nodes in the same host,
+   *  the data of these links goes through shared memory afterwards
+   * \param new_ranks ranks of nodes linked by new connections
+   * \param local_ranks ranks of the neighbors in the same host, given by tracker
+   */
+  void InitShmLinks(const std::vector<int> &new_ranks,
+                    const std::vector<int> &local_ranks);
+  /*!
+   * \brief setup the table of auto tuning, the table is taken from tracker if some node
+   *  already made it, otherwise rank 0 loads it from file or all the nodes calibrate it together,
+   *  if a link fails during the tuning, all the nodes reconnect and use the default methods
+   *  unless rank 0 already kept the table in tracker
+   */
+  void InitAutoTune(void);
+  /*!
+   * \brief make the table of auto tuning together in all the nodes at start up
+   * \param p_table used to store the table in text format
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   */
+  ReturnType TryMakeTuneTable(std::string *p_table);
+  /*!
+   * \brief benchmark the methods of allreduce and broadcast over a grid of message sizes,
+   *  and choose the fastest one for each size by the time of the slowest node
+   * \param p_table used to store the table in text format, which is the same in all the nodes
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   */
+  ReturnType TryCalibrateTuneTable(std::string *p_table);
+  /*!
+   * \brief whether the method of allreduce can be used for the message,
+   *  the result is the same in all the nodes
+   * \param method the method, see AllreduceMethod
+   * \param count number of elements to be reduced
+   */
+  bool AllreduceMethodAvailable(int method, size_t count) const;
+  /*!
+   * \brief whether the job uses double binary tree, either configured or tried by auto tuning,
+   *  the tracker only gives the links of the two trees in this case
+   */
+  inline bool NeedDoubleTree(void) const {
+    return use_double_tree != 0 || autotune != 0;
+  }
+  /*!
+   * \brief whether the job uses hierarchical allreduce, either configured or tried by auto tuning,
+   *  the tracker only gives the links to the host leaders in this case
+   */
+  inline bool NeedHierarchical(void) const {
+    return use_hierarchical != 0 || autotune != 0;
+  }
+  /*!
+   * \brief perform in-place allreduce with the given method
+   * \param method the method, see AllreduceMethod
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceMethod(int method,
+                                void *sendrecvbuf_,
+                                size_t type_nbytes,
+                                size_t count,
+                                ReduceFunction reducer);
   /*!
    * \brief perform in-place allreduce, on sendrecvbuf, this function can fail, and will return the cause of failure
    *
@@ -374,6 +644,270 @@ class AllreduceBase : public IEngine {
                           size_t type_nbytes,
                           size_t count,
                           ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce on the data of user, this is TryAllreduce that also
+   *  starts the partial sums in float of AllreduceSumFloat on the buffer of this try,
+   *  the engines use it for the data of Allreduce, and TryAllreduce for their own messages
+   * \param sendrecvbuf_ buffer for both sending and recving data, it can be a copy of the data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceData(void *sendrecvbuf_,
+                              size_t type_nbytes,
+                              size_t count,
+                              ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce, on sendrecvbuf,
+   *  using the reduction tree, this is the latency optimal method for small messages
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceTree(void *sendrecvbuf_,
+                              size_t type_nbytes,
+                              size_t count,
+                              ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce, on sendrecvbuf, using double binary tree,
+   *  the first half of data is reduced along one tree and the other half along the other tree
+   *  concurrently, a leaf in one tree is interior node in the other one,
+   *  so the bandwidth of all the nodes in both directions is used
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceDoubleTree(void *sendrecvbuf_,
+                                    size_t type_nbytes,
+                                    size_t count,
+                                    ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce, on sendrecvbuf, hierarchically:
+   *  the data is first reduced to the leader of each host, then allreduced among the leaders,
+   *  and the result is broadcasted back inside each host, the three steps are pipelined
+   *  along the tree given by tracker, in which only links between leaders go across hosts
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceHierarchical(void *sendrecvbuf_,
+                                      size_t type_nbytes,
+                                      size_t count,
+                                      ReduceFunction reducer);
+  /*!
+   * \brief run allreduce along several trees at the same time,
+   *  the trees must not share links with each other
+   *
+   * \param tasks the trees and the part of data reduced by each of them
+   * \param ntask number of tasks
+   * \param type_nbytes the unit number of bytes the type have
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduceTree
+   */
+  ReturnType TryAllreduceTreeTasks(TreeTask *tasks, int ntask,
+                                   size_t type_nbytes,
+                                   ReduceFunction reducer);
+  /*!
+   * \brief the same as TryAllreduceTreeTasks, but the data of links are passed by io_uring,
+   *  each link keeps a receive and a send in flight, and the completions are reaped in batch,
+   *  the links must not use shared memory
+   *
+   * \param tasks the trees and the part of data reduced by each of them
+   * \param ntask number of tasks
+   * \param type_nbytes the unit number of bytes the type have
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduceTreeTasks
+   */
+  ReturnType TryAllreduceTreeTasksURing(TreeTask *tasks, int ntask,
+                                        size_t type_nbytes,
+                                        ReduceFunction reducer);
+  /*!
+   * \brief reduce the data that all the children of the tree have passed up
+   * \param p_task the tree task
+   * \param type_nbytes the unit number of bytes the type have
+   * \param reducer reduce function
+   */
+  void ReduceTreeTask(TreeTask *p_task, size_t type_nbytes,
+                      ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce, on sendrecvbuf,
+   *  fast path for small messages along the reduction tree,
+   *  the message from each link is received as a whole into a stack buffer,
+   *  no ring buffer is involved, and select is only called when no progress can be made
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceSmall(void *sendrecvbuf_,
+                               size_t type_nbytes,
+                               size_t count,
+                               ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce, on sendrecvbuf,
+   *  using ring-based reduce-scatter followed by allgather,
+   *  every node sends and receives about 2 * total_size bytes regardless of world size,
+   *  which is the bandwidth optimal method for large messages
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceRing(void *sendrecvbuf_,
+                              size_t type_nbytes,
+                              size_t count,
+                              ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce, on sendrecvbuf,
+   *  using recursive halving reduce-scatter followed by recursive doubling allgather,
+   *  this takes 2 * log(n) steps and sends about 2 * total_size bytes in each node,
+   *  which suits medium size messages.
+   *  When world size is not power of 2, the extra nodes first hand their data to a partner,
+   *  and get the result back from the partner at the end
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryAllreduce
+   */
+  ReturnType TryAllreduceHalvingDoubling(void *sendrecvbuf_,
+                                         size_t type_nbytes,
+                                         size_t count,
+                                         ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allreduce of data that is mostly zero, on sendrecvbuf,
+   *  this function can fail, and will return the cause of failure
+   *
+   *  The data is divided into segments of rabit_sparse_segment elements, each segment
+   *  is encoded as offsets and values of its non-zero elements, or as dense values
+   *  when that is smaller. The encoded data of all the childs is read at the same time and
+   *  reduced up the tree, then the encoded result of the root is passed down the tree,
+   *  each node forwards it to its childs as it arrives.
+   *  Zero must be the identity of the reducer, as elements no node sets are not reduced.
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function, elements whose bytes are all zero must be identity of reducer
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType
+   */
+  ReturnType TrySparseAllreduce(void *sendrecvbuf_,
+                                size_t type_nbytes,
+                                size_t count,
+                                ReduceFunction reducer);
+  /*!
+   * \brief perform in-place reduce toward root along the tree, this function can fail,
+   *  and will return the cause of failure. The tree is rooted at root,
+   *  only the up pass of tree allreduce is performed
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \param root the root worker id to get the result
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType
+   */
+  ReturnType TryReduce(void *sendrecvbuf_,
+                       size_t type_nbytes,
+                       size_t count,
+                       ReduceFunction reducer,
+                       int root);
+  /*!
+   * \brief send and receive data with a peer at the same time
+   * \param link the link to the peer
+   * \param sendbuf_ buffer of data to be sent
+   * \param send_size size of data to be sent
+   * \param recvbuf_ buffer to store the received data
+   * \param recv_size size of data to be received
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType
+   */
+  ReturnType TryExchange(LinkRecord *link,
+                         const void *sendbuf_, size_t send_size,
+                         void *recvbuf_, size_t recv_size);
+  /*!
+   * \brief perform in-place reduce-scatter, on sendrecvbuf, this function can fail,
+   *  and will return the cause of failure
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param counts number of elements in the block of each node
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType
+   */
+  ReturnType TryReduceScatter(void *sendrecvbuf_,
+                              size_t type_nbytes,
+                              const std::vector<size_t> &counts,
+                              ReduceFunction reducer);
+  /*!
+   * \brief perform in-place reduce-scatter along the ring,
+   *  the data is divided into world_size slices, slice k covers elements [slice_ptr[k], slice_ptr[k + 1]),
+   *  after the call, slice r of sendrecvbuf in node r contains the reduced result of the slice
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param slice_ptr the beginning of each slice, in number of elements, size equals world_size + 1
+   * \param reducer reduce function
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType
+   */
+  ReturnType TryReduceScatterRing(void *sendrecvbuf_,
+                                  size_t type_nbytes,
+                                  const std::vector<size_t> &slice_ptr,
+                                  ReduceFunction reducer);
+  /*!
+   * \brief perform in-place allgather, on sendrecvbuf, this function can fail,
+   *  and will return the cause of failure
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param sizes size of the block of each node in bytes
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType
+   */
+  ReturnType TryAllgather(void *sendrecvbuf_, const std::vector<size_t> &sizes);
+  /*!
+   * \brief perform in-place allgather along the ring,
+   *  each node owns a slice of sendrecvbuf, the slices are ordered by rank,
+   *  after the call, the entire sendrecvbuf is filled with data of all nodes
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param total_size total size of data in bytes
+   * \param slice_begin beginning of the slice owned by current node
+   * \param slice_end end of the slice owned by current node
+   * \param size_prev_slice size of the slice owned by the previous node in the ring
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType
+   */
+  ReturnType TryAllgatherRing(void *sendrecvbuf_, size_t total_size,
+                              size_t slice_begin, size_t slice_end,
+                              size_t size_prev_slice);
   /*!
    * \brief broadcast data from root to all nodes, this function can fail,and will return the cause of failure
    * \param sendrecvbuf_ buffer for both sending and recving data
@@ -383,6 +917,60 @@ class AllreduceBase : public IEngine {
    * \sa ReturnType
    */
   ReturnType TryBroadcast(void *sendrecvbuf_, size_t size, int root);
+  /*!
+   * \brief broadcast data from root to all nodes by the method decided from size of the data,
+   *  without the codec
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param size the size of the data to be broadcasted
+   * \param root the root worker id to broadcast the data
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryBroadcast
+   */
+  ReturnType TryBroadcastRaw(void *sendrecvbuf_, size_t size, int root);
+  /*!
+   * \brief broadcast data from root to all nodes in the format of codec,
+   *  root first broadcasts the size of encoded data, which is 0 if the data is not compressible,
+   *  then the encoded data, or the data as it is
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param size the size of the data to be broadcasted
+   * \param root the root worker id to broadcast the data
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryBroadcast
+   */
+  ReturnType TryBroadcastCompressed(void *sendrecvbuf_, size_t size, int root);
+  /*!
+   * \brief broadcast data from root to all nodes by flooding over the tree,
+   *  this is the latency optimal method for small messages
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param size the size of the data to be broadcasted
+   * \param root the root worker id to broadcast the data
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryBroadcast
+   */
+  ReturnType TryBroadcastTree(void *sendrecvbuf_, size_t size, int root);
+  /*!
+   * \brief broadcast data from root to all nodes along the ring,
+   *  the data is pipelined in segments through the chain root, root + 1, ..., root - 1,
+   *  so every node sends the data at most once
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param size the size of the data to be broadcasted
+   * \param root the root worker id to broadcast the data
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryBroadcast
+   */
+  ReturnType TryBroadcastRing(void *sendrecvbuf_, size_t size, int root);
+  /*!
+   * \brief broadcast data from root to all nodes by scatter followed by ring allgather,
+   *  the data is divided into world_size slices, root passes slice k to node k along the ring,
+   *  then the slices are gathered by TryAllgatherRing,
+   *  root only sends out about total_size bytes in total
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param size the size of the data to be broadcasted
+   * \param root the root worker id to broadcast the data
+   * \return this function can return kSuccess, kSockError, kGetExcept, see ReturnType for details
+   * \sa ReturnType, TryBroadcast
+   */
+  ReturnType TryBroadcastScatter(void *sendrecvbuf_, size_t size, int root);
   /*!
    * \brief function used to report error when a link goes wrong 
    * \param link the pointer to the link who causes the error
@@ -391,6 +979,17 @@ class AllreduceBase : public IEngine {
   inline ReturnType ReportError(LinkRecord *link, ReturnType err) {
     err_link = link; return err;
   }
+  /*!
+   * \brief get the size of ring buffer of each link that receives data to be reduced,
+   *  the reduce buffer is divided among the links, so that memory does not grow with tree arity
+   * \param nchild number of links that receives data to be reduced
+   * \param type_nbytes the unit number of bytes the type have
+   * \return the buffer size in number of 64 bit words, which can hold at least one element
+   */
+  inline size_t ChildBufferSize(int nchild, size_t type_nbytes) const {
+    size_t n = reduce_buffer_size / static_cast<size_t>(std::max(nchild, 1));
+    return std::max(n, (type_nbytes + 7) / 8);
+  }
   //---- data structure related to model ----
   // call sequence counter, records how many calls we made so far
   // from last call to CheckPoint, LoadCheckPoint
@@ -404,18 +1003,52 @@ class AllreduceBase : public IEngine {
   int parent_index;
   // rank of parent node, can be -1
   int parent_rank;
+  // rank of parent of each node in the tree, -1 for the root of the tree
+  std::vector<int> tree_parents;
   // sockets of all links this connects to
   std::vector<LinkRecord> all_links;
   // used to record the link where things goes wrong
   LinkRecord *err_link;
+  // waits for the events of links, kept across the collectives
+  utils::PollHelper poller;
+  // policy and counters of spinning before blocking when waiting for the links
+  utils::BusyPoll busy_poll;
+  // whether to pass the data of tree allreduce by io_uring
+  int use_uring;
+  // queues of io_uring, not open if io_uring is not used or not supported
+  utils::URing uring;
   // all the links in the reduction tree connection
   RefLinkVector tree_links;
   // pointer to links in the ring
   LinkRecord *ring_prev, *ring_next;
+  // links used by recursive halving and doubling, in the order of use:
+  // the partner of pairing step if world size is not power of 2,
+  // followed by the partner in each round of recursive halving
+  RefLinkVector hd_links;
+  // links of the two trees used by double binary tree allreduce, empty unless NeedDoubleTree
+  RefLinkVector dtree_links[2];
+  // index of parent link in each tree of double binary tree, -1 for root
+  int dtree_parent_index[2];
+  // number of trees of double binary tree given by tracker, 0 or 2
+  int num_dtree;
+  // whether to use double binary tree allreduce when it is available
+  int use_double_tree;
+  // maximum number of childs of each node in the reduction tree, sent to tracker
+  int tree_arity;
+  // links of hierarchical allreduce: the leader of each host links to the other nodes
+  // in the host and to the leaders of other hosts, other nodes only link to their leader,
+  // empty unless NeedHierarchical
+  RefLinkVector hier_links;
+  // index of parent link in hier_links, -1 for root
+  int hier_parent_index;
+  // whether to use hierarchical allreduce
+  int use_hierarchical;
   //----- meta information-----
   // unique identifier of the possible job this process is doing
   // used to assign ranks, optional, default to NULL
   std::string task_id;
+  // rack or zone label of the node, used by tracker to place nodes, optional, default to NULL
+  std::string zone;
   // uri of current host, to be set by Init
   std::string host_uri;
   // uri of tracker
@@ -424,8 +1057,47 @@ class AllreduceBase : public IEngine {
   int tracker_port;
   // port of slave process
   int slave_port, nport_trial;
+  // directory of unix domain socket listened by slave process, NULL to disable
+  std::string unix_dir;
   // reduce buffer size
   size_t reduce_buffer_size;
+  // size of each direction of shared memory ring buffer of links in the same host, 0 to disable
+  size_t shm_buffer_size;
+  // messages larger than this size in bytes are reduced or broadcasted along the ring
+  size_t ring_threshold;
+  // maximum size of data passed in one step of ring broadcast
+  size_t bcast_segment;
+  // number of elements in each segment of sparse allreduce
+  size_t sparse_segment;
+  // method of broadcast, see BroadcastMethod
+  int bcast_method;
+  // messages larger than this size in bytes are reduced by recursive halving and doubling
+  size_t halving_threshold;
+  // messages no larger than this size in bytes are reduced by the small message fast path
+  size_t small_threshold;
+  // format of float data passed on the wire by float sum allreduce
+  utils::FloatFormat wire_dtype;
+  // state of the running float sum allreduce passed in 16 bit, given to the reduce function,
+  // it is set by AllreduceSumFloat and started by TryAllreduceData in each try
+  WireSum wire_sum;
+  // the buffer of data in 16 bit, kept across the calls
+  std::vector<uint16_t> wire_buffer;
+  // whether to compress broadcast and checkpoint data by the codec
+  int compress;
+  // broadcast of messages no smaller than this size in bytes is compressed
+  size_t compress_min;
+  // whether to calibrate the methods of allreduce and broadcast at start
+  int autotune;
+  // file to keep the table of auto tuning, NULL for no file
+  std::string autotune_file;
+  // largest message size in bytes benchmarked by auto tuning
+  size_t autotune_max;
+  // whether rank 0 prints the table of auto tuning
+  int autotune_dump;
+  // table of auto tuning, empty if auto tuning is off
+  TuneTable tune_table;
+  // table of auto tuning given by tracker in text format, empty if no node has made it
+  std::string tracker_tune_table;
   // current rank
   int rank;
   // world size
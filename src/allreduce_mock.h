@@ -53,10 +53,45 @@ class AllreduceMock : public AllreduceRobust {
                                count, reducer, prepare_fun, prepare_arg);
     tsum_allreduce += utils::GetTime() - tstart;
   }
+  virtual void SparseAllreduce(void *sendrecvbuf_,
+                               size_t type_nbytes,
+                               size_t count,
+                               ReduceFunction reducer,
+                               PreprocFunction prepare_fun,
+                               void *prepare_arg) {
+    this->Verify(MockKey(rank, version_number, seq_counter, num_trial), "SparseAllreduce");
+    AllreduceRobust::SparseAllreduce(sendrecvbuf_, type_nbytes, count,
+                                     reducer, prepare_fun, prepare_arg);
+  }
+  virtual void Reduce(void *sendrecvbuf_,
+                      size_t type_nbytes,
+                      size_t count,
+                      ReduceFunction reducer,
+                      int root,
+                      PreprocFunction prepare_fun,
+                      void *prepare_arg) {
+    this->Verify(MockKey(rank, version_number, seq_counter, num_trial), "Reduce");
+    AllreduceRobust::Reduce(sendrecvbuf_, type_nbytes, count,
+                            reducer, root, prepare_fun, prepare_arg);
+  }
   virtual void Broadcast(void *sendrecvbuf_, size_t total_size, int root) {
     this->Verify(MockKey(rank, version_number, seq_counter, num_trial), "Broadcast");
     AllreduceRobust::Broadcast(sendrecvbuf_, total_size, root);
   }
+  virtual void ReduceScatter(void *sendrecvbuf_,
+                             size_t type_nbytes,
+                             const std::vector<size_t> &counts,
+                             ReduceFunction reducer,
+                             PreprocFunction prepare_fun,
+                             void *prepare_arg) {
+    this->Verify(MockKey(rank, version_number, seq_counter, num_trial), "ReduceScatter");
+    AllreduceRobust::ReduceScatter(sendrecvbuf_, type_nbytes, counts,
+                                   reducer, prepare_fun, prepare_arg);
+  }
+  virtual void Allgatherv(void *sendrecvbuf_, const std::vector<size_t> &sizes) {
+    this->Verify(MockKey(rank, version_number, seq_counter, num_trial), "Allgather");
+    AllreduceRobust::Allgatherv(sendrecvbuf_, sizes);
+  }
   virtual int LoadCheckPoint(ISerializable *global_model,
                              ISerializable *local_model) {
     tsum_allreduce = 0.0;
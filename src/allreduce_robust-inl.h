@@ -70,7 +70,7 @@ AllreduceRobust::MsgPassing(const NodeType &node_value,
       utils::Assert(stage != 2 && stage != 1, "invalie stage id");
     }
     // select helper
-    utils::SelectHelper selecter;
+    utils::PollHelper &selecter = poller.Begin();
     bool done = (stage == 3);
     for (int i = 0; i < nlink; ++i) {
       selecter.WatchException(links[i].sock);
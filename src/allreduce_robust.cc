@@ -15,6 +15,7 @@
 #include "../include/rabit/engine.h"
 #include "../include/rabit/rabit-inl.h"
 #include "./allreduce_robust.h"
+#include "./codec.h"
 
 namespace rabit {
 namespace engine {
@@ -94,7 +95,7 @@ void AllreduceRobust::Allreduce(void *sendrecvbuf_,
       std::memcpy(temp, sendrecvbuf_, type_nbytes * count); break;
     } else {
       std::memcpy(temp, sendrecvbuf_, type_nbytes * count);
-      if (CheckAndRecover(TryAllreduce(temp, type_nbytes, count, reducer))) {
+      if (CheckAndRecover(TryAllreduceData(temp, type_nbytes, count, reducer))) {
         std::memcpy(sendrecvbuf_, temp, type_nbytes * count); break;
       } else {
         recovered = RecoverExec(sendrecvbuf_, type_nbytes * count, 0, seq_counter);
@@ -104,6 +105,77 @@ void AllreduceRobust::Allreduce(void *sendrecvbuf_,
   resbuf.PushTemp(seq_counter, type_nbytes, count);
   seq_counter += 1;
 }
+/*!
+ * \brief perform in-place allreduce of data that is mostly zero, on sendrecvbuf
+ *        this function is NOT thread-safe
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+ *                     will be called by the function before performing Allreduce, to intialize the data in sendrecvbuf_.
+ *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to passed into the lazy preprocessing function
+ */
+void AllreduceRobust::SparseAllreduce(void *sendrecvbuf_,
+                                      size_t type_nbytes,
+                                      size_t count,
+                                      ReduceFunction reducer,
+                                      PreprocFunction prepare_fun,
+                                      void *prepare_arg) {
+  // skip action in single node
+  if (world_size == 1) {
+    if (prepare_fun != NULL) prepare_fun(prepare_arg);
+    return;
+  }
+  bool recovered = RecoverExec(sendrecvbuf_, type_nbytes * count, 0, seq_counter);
+  // now we are free to remove the last result, if any
+  if (resbuf.LastSeqNo() != -1 &&
+      (resbuf.LastSeqNo() % result_buffer_round != rank % result_buffer_round)) {
+    resbuf.DropLast();
+  }
+  if (!recovered && prepare_fun != NULL) prepare_fun(prepare_arg);
+  void *temp = resbuf.AllocTemp(type_nbytes, count);
+  while (true) {
+    if (recovered) {
+      std::memcpy(temp, sendrecvbuf_, type_nbytes * count); break;
+    } else {
+      std::memcpy(temp, sendrecvbuf_, type_nbytes * count);
+      if (CheckAndRecover(TrySparseAllreduce(temp, type_nbytes, count, reducer))) {
+        std::memcpy(sendrecvbuf_, temp, type_nbytes * count); break;
+      } else {
+        recovered = RecoverExec(sendrecvbuf_, type_nbytes * count, 0, seq_counter);
+      }
+    }
+  }
+  resbuf.PushTemp(seq_counter, type_nbytes, count);
+  seq_counter += 1;
+}
+/*!
+ * \brief perform in-place reduce, on sendrecvbuf, only root gets the result
+ *        this function is NOT thread-safe
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param count number of elements to be reduced
+ * \param reducer reduce function
+ * \param root the root worker id to get the result
+ * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+ *                     will be called by the function before performing Reduce, to intialize the data in sendrecvbuf_.
+ *                     If the result of Reduce can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to passed into the lazy preprocessing function
+ */
+void AllreduceRobust::Reduce(void *sendrecvbuf_,
+                             size_t type_nbytes,
+                             size_t count,
+                             ReduceFunction reducer,
+                             int root,
+                             PreprocFunction prepare_fun,
+                             void *prepare_arg) {
+  utils::Check(root >= 0 && root < GetWorldSize(), "Reduce: invalid root");
+  // the result must be kept by every node, so that a restarted root can recover it
+  AllreduceRobust::Allreduce(sendrecvbuf_, type_nbytes, count,
+                             reducer, prepare_fun, prepare_arg);
+}
 /*!
  * \brief broadcast data from root to all nodes
  * \param sendrecvbuf_ buffer for both sending and recving data
@@ -134,6 +206,71 @@ void AllreduceRobust::Broadcast(void *sendrecvbuf_, size_t total_size, int root)
   resbuf.PushTemp(seq_counter, 1, total_size);
   seq_counter += 1;
 }
+/*!
+ * \brief perform in-place allgather of blocks with different size, on sendrecvbuf
+ *        this function is NOT thread-safe
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param sizes size of the block of each node in bytes
+ */
+void AllreduceRobust::Allgatherv(void *sendrecvbuf_, const std::vector<size_t> &sizes) {
+  // skip action in single node
+  if (world_size == 1) return;
+  utils::Check(sizes.size() == static_cast<size_t>(world_size),
+               "Allgather: size of sizes must equal world size");
+  size_t total_size = 0;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    total_size += sizes[i];
+  }
+  bool recovered = RecoverExec(sendrecvbuf_, total_size, 0, seq_counter);
+  // now we are free to remove the last result, if any
+  if (resbuf.LastSeqNo() != -1 &&
+      (resbuf.LastSeqNo() % result_buffer_round != rank % result_buffer_round)) {
+    resbuf.DropLast();
+  }
+  void *temp = resbuf.AllocTemp(1, total_size);
+  while (true) {
+    if (recovered) {
+      std::memcpy(temp, sendrecvbuf_, total_size); break;
+    } else {
+      // the block of current node is never overwritten by a failed attempt, retry is safe
+      if (CheckAndRecover(TryAllgather(sendrecvbuf_, sizes))) {
+        std::memcpy(temp, sendrecvbuf_, total_size); break;
+      } else {
+        recovered = RecoverExec(sendrecvbuf_, total_size, 0, seq_counter);
+      }
+    }
+  }
+  resbuf.PushTemp(seq_counter, 1, total_size);
+  seq_counter += 1;
+}
+/*!
+ * \brief perform in-place reduce-scatter, on sendrecvbuf
+ *        this function is NOT thread-safe
+ * \param sendrecvbuf_ buffer for both sending and recving data
+ * \param type_nbytes the unit number of bytes the type have
+ * \param counts number of elements in the block of each node
+ * \param reducer reduce function
+ * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+ *                     will be called by the function before performing ReduceScatter, to intialize the data in sendrecvbuf_.
+ *                     If the result of ReduceScatter can be recovered directly, then prepare_func will NOT be called
+ * \param prepare_arg argument used to passed into the lazy preprocessing function
+ */
+void AllreduceRobust::ReduceScatter(void *sendrecvbuf_,
+                                    size_t type_nbytes,
+                                    const std::vector<size_t> &counts,
+                                    ReduceFunction reducer,
+                                    PreprocFunction prepare_fun,
+                                    void *prepare_arg) {
+  utils::Check(counts.size() == static_cast<size_t>(GetWorldSize()),
+               "ReduceScatter: size of counts must equal world size");
+  size_t count = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    count += counts[i];
+  }
+  // reduce the entire buffer, so that the cached result can recover any node
+  AllreduceRobust::Allreduce(sendrecvbuf_, type_nbytes, count,
+                             reducer, prepare_fun, prepare_arg);
+}
 /*!
  * \brief load latest check point
  * \param global_model pointer to the globally shared model/state
@@ -171,8 +308,15 @@ int AllreduceRobust::LoadCheckPoint(ISerializable *global_model,
     if (local_model != NULL) {
       if (nlocal == num_local_replica + 1) {
         // load in local model
-        utils::MemoryFixSizeBuffer fs(BeginPtr(local_chkpt[local_chkpt_version]),
-                                      local_rptr[local_chkpt_version][1]);
+        char *chkpt = BeginPtr(local_chkpt[local_chkpt_version]);
+        size_t size = local_rptr[local_chkpt_version][1];
+        std::string data;
+        if (compress != 0) {
+          data.resize(utils::CodecDecodedSize(chkpt, size));
+          utils::CodecDecode(chkpt, size, BeginPtr(data));
+          chkpt = BeginPtr(data); size = data.length();
+        }
+        utils::MemoryFixSizeBuffer fs(chkpt, size);
         local_model->Load(fs);
       } else {
         utils::Assert(nlocal == 0, "[%d] local model inconsistent, nlocal=%d", rank, nlocal);
@@ -181,8 +325,15 @@ int AllreduceRobust::LoadCheckPoint(ISerializable *global_model,
     // reset result buffer
     resbuf.Clear(); seq_counter = 0;
     // load from buffer
-    utils::MemoryBufferStream fs(&global_checkpoint);
-    if (global_checkpoint.length() == 0) {
+    std::string data, *chkpt = &global_checkpoint;
+    if (compress != 0 && global_checkpoint.length() != 0) {
+      data.resize(utils::CodecDecodedSize(BeginPtr(global_checkpoint),
+                                          global_checkpoint.length()));
+      utils::CodecDecode(BeginPtr(global_checkpoint), global_checkpoint.length(), BeginPtr(data));
+      chkpt = &data;
+    }
+    utils::MemoryBufferStream fs(chkpt);
+    if (chkpt->length() == 0) {
       version_number = 0;
     } else {
       utils::Assert(fs.Read(&version_number, sizeof(version_number)) != 0,
@@ -202,6 +353,15 @@ int AllreduceRobust::LoadCheckPoint(ISerializable *global_model,
     return version_number;
   }
 }
+/*!
+ * \brief replace the global checkpoint by its encoded form,
+ *  which is what passed to the nodes that recover from failure
+ */
+void AllreduceRobust::EncodeGlobalCheckPoint(void) {
+  std::string data;
+  utils::CodecEncode(BeginPtr(global_checkpoint), global_checkpoint.length(), &data);
+  global_checkpoint.swap(data);
+}
 /*!
  * \brief internal consistency check function,
  *  use check to ensure user always call CheckPoint/LoadCheckPoint
@@ -261,6 +421,13 @@ void AllreduceRobust::CheckPoint_(const ISerializable *global_model,
       if (local_model != NULL) {
         local_model->Save(fs);
       }
+      // the encoded state is passed to and kept by other nodes
+      if (compress != 0) {
+        std::string data;
+        utils::CodecEncode(BeginPtr(local_chkpt[new_version]),
+                           local_chkpt[new_version].length(), &data);
+        local_chkpt[new_version].swap(data);
+      }
       local_rptr[new_version].clear();
       local_rptr[new_version].push_back(0);
       local_rptr[new_version].push_back(local_chkpt[new_version].length());
@@ -287,6 +454,7 @@ void AllreduceRobust::CheckPoint_(const ISerializable *global_model,
     fs.Write(&version_number, sizeof(version_number));
     global_model->Save(fs);
     global_lazycheck = NULL;
+    if (compress != 0) this->EncodeGlobalCheckPoint();
   }
   // reset result buffer
   resbuf.Clear(); seq_counter = 0;
@@ -326,7 +494,7 @@ AllreduceRobust::ReturnType AllreduceRobust::TryResetLinks(void) {
         if (len == sizeof(sig)) all_links[i].size_write = 2;
       }
     }
-    utils::SelectHelper rsel;
+    utils::PollHelper &rsel = poller.Begin();
     bool finished = true;
     for (int i = 0; i < nlink; ++i) {
       if (all_links[i].size_write != 2 && !all_links[i].sock.BadSocket()) {
@@ -343,7 +511,7 @@ AllreduceRobust::ReturnType AllreduceRobust::TryResetLinks(void) {
     }
   }
   while (true) {
-    utils::SelectHelper rsel;
+    utils::PollHelper &rsel = poller.Begin();
     bool finished = true;
     for (int i = 0; i < nlink; ++i) {
       if (all_links[i].size_read == 0 && !all_links[i].sock.BadSocket()) {
@@ -616,7 +784,7 @@ AllreduceRobust::TryRecoverData(RecoverType role,
   }
   while (true) {
     bool finished = true;
-    utils::SelectHelper selecter;
+    utils::PollHelper &selecter = poller.Begin();
     for (int i = 0; i < nlink; ++i) {
       if (i == recv_link && links[i].size_read != size) {
         selecter.WatchRead(links[i].sock);
@@ -675,7 +843,7 @@ AllreduceRobust::TryRecoverData(RecoverType role,
           if (req_in[i]) min_write = std::min(links[i].size_write, min_write);
         }
         utils::Assert(min_write <= links[pid].size_read, "boundary check");
-        ReturnType ret = links[pid].ReadToRingBuffer(min_write);
+        ReturnType ret = links[pid].ReadToRingBuffer(min_write, size);
         if (ret != kSuccess) {
           return ReportError(&links[pid], ret);
         }
@@ -748,6 +916,7 @@ AllreduceRobust::ReturnType AllreduceRobust::TryLoadCheckPoint(bool requester) {
     fs.Write(&version_number, sizeof(version_number));
     global_lazycheck->Save(fs);
     global_lazycheck = NULL;
+    if (compress != 0) this->EncodeGlobalCheckPoint();
   }
   // recover global checkpoint
   size_t size = this->global_checkpoint.length();
@@ -1136,7 +1305,7 @@ AllreduceRobust::RingPassing(void *sendrecvbuf_,
   char *buf = reinterpret_cast<char*>(sendrecvbuf_);
   while (true) {
     bool finished = true;
-    utils::SelectHelper selecter;
+    utils::PollHelper &selecter = poller.Begin();
     if (read_ptr != read_end) {
       selecter.WatchRead(prev.sock);
       finished = false;
@@ -51,6 +51,49 @@ class AllreduceRobust : public AllreduceBase {
                          ReduceFunction reducer,
                          PreprocFunction prepare_fun = NULL,
                          void *prepare_arg = NULL);
+  /*!
+   * \brief perform in-place allreduce of data that is mostly zero, on sendrecvbuf
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Allreduce, to intialize the data in sendrecvbuf_.
+   *                     If the result of Allreduce can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to passed into the lazy preprocessing function
+   */
+  virtual void SparseAllreduce(void *sendrecvbuf_,
+                               size_t type_nbytes,
+                               size_t count,
+                               ReduceFunction reducer,
+                               PreprocFunction prepare_fun = NULL,
+                               void *prepare_arg = NULL);
+  /*!
+   * \brief perform in-place reduce, on sendrecvbuf, only root gets the result
+   *        this function is NOT thread-safe
+   *
+   *  Nodes other than root finish as soon as their data is passed on, when root fails
+   *  after that, no other node can recover the result. To keep the result recoverable,
+   *  the robust version performs Allreduce and caches the result in all nodes.
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param count number of elements to be reduced
+   * \param reducer reduce function
+   * \param root the root worker id to get the result
+   * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+   *                     will be called by the function before performing Reduce, to intialize the data in sendrecvbuf_.
+   *                     If the result of Reduce can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to passed into the lazy preprocessing function
+   */
+  virtual void Reduce(void *sendrecvbuf_,
+                      size_t type_nbytes,
+                      size_t count,
+                      ReduceFunction reducer,
+                      int root,
+                      PreprocFunction prepare_fun = NULL,
+                      void *prepare_arg = NULL);
   /*!
    * \brief broadcast data from root to all nodes
    * \param sendrecvbuf_ buffer for both sending and recving data
@@ -58,6 +101,36 @@ class AllreduceRobust : public AllreduceBase {
    * \param root the root worker id to broadcast the data
    */
   virtual void Broadcast(void *sendrecvbuf_, size_t total_size, int root);
+  /*!
+   * \brief perform in-place reduce-scatter, on sendrecvbuf
+   *        this function is NOT thread-safe
+   *
+   *  The result kept in the result buffer must be the same in all nodes, so that it
+   *  can be used to recover any of the nodes. To keep this property, the robust
+   *  version reduces the entire buffer, the result is a superset of the ReduceScatter result.
+   *
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param type_nbytes the unit number of bytes the type have
+   * \param counts number of elements in the block of each node
+   * \param reducer reduce function
+   * \param prepare_func Lazy preprocessing function, lazy prepare_fun(prepare_arg)
+   *                     will be called by the function before performing ReduceScatter, to intialize the data in sendrecvbuf_.
+   *                     If the result of ReduceScatter can be recovered directly, then prepare_func will NOT be called
+   * \param prepare_arg argument used to passed into the lazy preprocessing function
+   */
+  virtual void ReduceScatter(void *sendrecvbuf_,
+                             size_t type_nbytes,
+                             const std::vector<size_t> &counts,
+                             ReduceFunction reducer,
+                             PreprocFunction prepare_fun = NULL,
+                             void *prepare_arg = NULL);
+  /*!
+   * \brief perform in-place allgather of blocks with different size, on sendrecvbuf
+   *        this function is NOT thread-safe
+   * \param sendrecvbuf_ buffer for both sending and recving data
+   * \param sizes size of the block of each node in bytes
+   */
+  virtual void Allgatherv(void *sendrecvbuf_, const std::vector<size_t> &sizes);
   /*!
    * \brief load latest check point
    * \param global_model pointer to the globally shared model/state
@@ -307,6 +380,11 @@ class AllreduceRobust : public AllreduceBase {
    * \param with_local whether the user calls CheckPoint with local model
    */
   void LocalModelCheck(bool with_local);
+  /*!
+   * \brief replace the global checkpoint by its encoded form,
+   *  which is what passed to the nodes that recover from failure
+   */
+  void EncodeGlobalCheckPoint(void);
   /*!
    * \brief internal implementation of checkpoint, support both lazy and normal way
    * 
@@ -0,0 +1,189 @@
+/*!
+ *  Copyright (c) 2014 by Contributors
+ * \file codec.h
+ * \brief fast lossless codec for serialized models, which are often full of zeros,
+ *   data is cut into segments, each segment is encoded as runs of zero bytes and literal bytes,
+ *   or stored as it is when the encoding does not make it smaller
+ */
+#ifndef RABIT_CODEC_H_
+#define RABIT_CODEC_H_
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include "../include/rabit/utils.h"
+
+namespace rabit {
+namespace utils {
+/*! \brief number of bytes in each segment of codec */
+const size_t kCodecSegment = 1 << 16;
+/*! \brief zero runs shorter than this are kept in the literal */
+const size_t kCodecMinZeroRun = 8;
+/*! \brief flag in segment header telling the segment is stored as it is */
+const uint32_t kCodecRawFlag = 1U << 31;
+/*!
+ * \brief append a run to the encoded segment
+ * \param out the end of output
+ * \param end the end of output space
+ * \param len length of the run
+ * \param literal the literal bytes, NULL for zero run
+ * \return new end of output, NULL if there is no enough space
+ */
+inline char *CodecPutRun(char *out, const char *end, size_t len, const char *literal) {
+  // the header is a varint of (len << 1 | is_literal)
+  uint64_t h = (static_cast<uint64_t>(len) << 1) | (literal != NULL);
+  do {
+    if (out == end) return NULL;
+    *out++ = static_cast<char>((h & 0x7f) | (h >= 0x80 ? 0x80 : 0));
+    h >>= 7;
+  } while (h != 0);
+  if (literal != NULL) {
+    if (static_cast<size_t>(end - out) < len) return NULL;
+    std::memcpy(out, literal, len);
+    out += len;
+  }
+  return out;
+}
+/*!
+ * \brief encode one segment
+ * \param src the data
+ * \param n size of data
+ * \param dst output space of n bytes
+ * \return size of encoded data, or n + 1 if the encoding is not smaller than the data
+ */
+inline size_t CodecEncodeSegment(const char *src, size_t n, char *dst) {
+  char *out = dst, *end = dst + n;
+  size_t i = 0, lit = 0;
+  while (i < n) {
+    // memchr skips the non-zero bytes quickly
+    const void *p = std::memchr(src + i, 0, n - i);
+    if (p == NULL) break;
+    i = static_cast<const char*>(p) - src;
+    size_t j = i;
+    while (j + sizeof(uint64_t) <= n) {
+      uint64_t w;
+      std::memcpy(&w, src + j, sizeof(w));
+      if (w != 0) break;
+      j += sizeof(uint64_t);
+    }
+    while (j < n && src[j] == 0) ++j;
+    if (j - i >= kCodecMinZeroRun) {
+      if (i != lit) {
+        out = CodecPutRun(out, end, i - lit, src + lit);
+        if (out == NULL) return n + 1;
+      }
+      out = CodecPutRun(out, end, j - i, NULL);
+      if (out == NULL) return n + 1;
+      lit = j;
+    }
+    i = j;
+  }
+  if (lit != n) {
+    out = CodecPutRun(out, end, n - lit, src + lit);
+    if (out == NULL) return n + 1;
+  }
+  return out - dst;
+}
+/*!
+ * \brief decode one segment
+ * \param src the encoded data
+ * \param n size of encoded data
+ * \param dst output space
+ * \param size size of decoded data
+ */
+inline void CodecDecodeSegment(const char *src, size_t n, char *dst, size_t size) {
+  const char *end = src + n;
+  size_t pos = 0;
+  while (src != end) {
+    uint64_t h = 0;
+    int shift = 0;
+    while (true) {
+      Check(src != end && shift < 64, "Codec: invalid encoded data");
+      const unsigned char c = static_cast<unsigned char>(*src++);
+      h |= static_cast<uint64_t>(c & 0x7f) << shift;
+      shift += 7;
+      if ((c & 0x80) == 0) break;
+    }
+    const size_t len = static_cast<size_t>(h >> 1);
+    Check(len <= size - pos, "Codec: invalid encoded data");
+    if ((h & 1) != 0) {
+      Check(len <= static_cast<size_t>(end - src), "Codec: invalid encoded data");
+      std::memcpy(dst + pos, src, len);
+      src += len;
+    } else {
+      std::memset(dst + pos, 0, len);
+    }
+    pos += len;
+  }
+  Check(pos == size, "Codec: invalid encoded data");
+}
+/*!
+ * \brief encode data, the output starts with the size of data,
+ *  followed by segments, each with a 32 bit header of the encoded size and raw flag
+ * \param src_ the data
+ * \param size size of data
+ * \param out the output
+ */
+inline void CodecEncode(const void *src_, size_t size, std::string *out) {
+  const char *src = static_cast<const char*>(src_);
+  const size_t nseg = (size + kCodecSegment - 1) / kCodecSegment;
+  out->resize(sizeof(uint64_t) + nseg * sizeof(uint32_t) + size);
+  char *dst = &(*out)[0];
+  const uint64_t nbytes = size;
+  std::memcpy(dst, &nbytes, sizeof(nbytes));
+  size_t pos = sizeof(nbytes);
+  for (size_t begin = 0; begin < size; begin += kCodecSegment) {
+    const size_t n = std::min(kCodecSegment, size - begin);
+    uint32_t header = static_cast<uint32_t>(CodecEncodeSegment(src + begin, n,
+                                                               dst + pos + sizeof(header)));
+    if (header > n) {
+      std::memcpy(dst + pos + sizeof(header), src + begin, n);
+      header = static_cast<uint32_t>(n) | kCodecRawFlag;
+    }
+    std::memcpy(dst + pos, &header, sizeof(header));
+    pos += sizeof(header) + (header & ~kCodecRawFlag);
+  }
+  out->resize(pos);
+}
+/*!
+ * \brief get the size of decoded data
+ * \param src the encoded data
+ * \param n size of encoded data
+ */
+inline size_t CodecDecodedSize(const void *src, size_t n) {
+  uint64_t nbytes;
+  Check(n >= sizeof(nbytes), "Codec: invalid encoded data");
+  std::memcpy(&nbytes, src, sizeof(nbytes));
+  return static_cast<size_t>(nbytes);
+}
+/*!
+ * \brief decode data
+ * \param src_ the encoded data
+ * \param n size of encoded data
+ * \param dst_ output space, its size must be CodecDecodedSize(src_, n)
+ */
+inline void CodecDecode(const void *src_, size_t n, void *dst_) {
+  const char *src = static_cast<const char*>(src_);
+  char *dst = static_cast<char*>(dst_);
+  const size_t size = CodecDecodedSize(src, n);
+  size_t pos = sizeof(uint64_t);
+  for (size_t begin = 0; begin < size; begin += kCodecSegment) {
+    const size_t len = std::min(kCodecSegment, size - begin);
+    uint32_t header;
+    Check(n - pos >= sizeof(header), "Codec: invalid encoded data");
+    std::memcpy(&header, src + pos, sizeof(header));
+    pos += sizeof(header);
+    const size_t nenc = header & ~kCodecRawFlag;
+    Check(nenc <= n - pos, "Codec: invalid encoded data");
+    if ((header & kCodecRawFlag) != 0) {
+      Check(nenc == len, "Codec: invalid encoded data");
+      std::memcpy(dst + begin, src + pos, len);
+    } else {
+      CodecDecodeSegment(src + pos, nenc, dst + begin, len);
+    }
+    pos += nenc;
+  }
+  Check(pos == n, "Codec: invalid encoded data");
+}
+}  // namespace utils
+}  // namespace rabit
+#endif  // RABIT_CODEC_H_
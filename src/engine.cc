@@ -10,6 +10,10 @@
 #define _CRT_SECURE_NO_DEPRECATE
 #define NOMINMAX
 
+#include <deque>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 #include "../include/rabit/engine.h"
 #include "./allreduce_base.h"
 #include "./allreduce_robust.h"
@@ -27,6 +31,162 @@ AllreduceMock manager;
 AllreduceBase manager;
 #endif
 
+/*! \brief a non-blocking collective waiting to be done */
+struct AsyncTask {
+  /*! \brief whether it is Allreduce, otherwise it is Broadcast */
+  bool allreduce;
+  void *buf;
+  size_t type_nbytes, count;
+  IEngine::ReduceFunction *red;
+  mpi::DataType dtype;
+  mpi::OpType op;
+  IEngine::PreprocFunction *prepare_fun;
+  void *prepare_arg;
+  int root;
+  // do the collective, the same as the blocking version
+  inline void Run(void) const {
+    if (allreduce) {
+      Allreduce_(buf, type_nbytes, count, red, dtype, op, prepare_fun, prepare_arg);
+    } else {
+      GetIdleEngine()->Broadcast(buf, count, root);
+    }
+  }
+};
+/*!
+ * \brief runs the non-blocking collectives in a progress thread, one by one in the order
+ *  they are issued, so every node sees the same sequence of collectives as in blocking mode,
+ *  and the robust engine can still number and recover them the same way
+ */
+class AsyncEngine {
+ public:
+  AsyncEngine(void) : started_(false), stop_(false), nissued_(0), ndone_(0) {
+#ifndef _WIN32
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+#endif
+  }
+  /*!
+   * \brief issue a task
+   * \return id of the request
+   */
+  inline uint64_t Push(const AsyncTask &task) {
+#ifdef _WIN32
+    // no progress thread, finish the task right away
+    task.Run();
+    ndone_ = ++nissued_;
+    return nissued_;
+#else
+    pthread_mutex_lock(&mutex_);
+    utils::Assert(!InProgressThread(), "cannot issue non-blocking collective in prepare function");
+    if (!started_) {
+      // the progress thread locks the mutex first, so it sees thread_ and started_ set
+      stop_ = false;
+      utils::Check(pthread_create(&thread_, NULL, ThreadMain, this) == 0,
+                   "AsyncEngine: fail to create progress thread");
+      started_ = true;
+    }
+    queue_.push_back(task);
+    const uint64_t id = ++nissued_;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    return id;
+#endif
+  }
+  /*! \brief whether request id has finished */
+  inline bool Test(uint64_t id) {
+#ifndef _WIN32
+    pthread_mutex_lock(&mutex_);
+    const bool done = ndone_ >= id;
+    pthread_mutex_unlock(&mutex_);
+    return done;
+#else
+    return ndone_ >= id;
+#endif
+  }
+  /*! \brief wait until request id finishes */
+  inline void Wait(uint64_t id) {
+#ifndef _WIN32
+    pthread_mutex_lock(&mutex_);
+    this->WaitLocked(id);
+    pthread_mutex_unlock(&mutex_);
+#endif
+  }
+  /*! \brief wait until all the issued requests finish */
+  inline void WaitAll(void) {
+#ifndef _WIN32
+    pthread_mutex_lock(&mutex_);
+    this->WaitLocked(nissued_);
+    pthread_mutex_unlock(&mutex_);
+#endif
+  }
+  /*! \brief finish the requests and stop the progress thread */
+  inline void Shutdown(void) {
+#ifndef _WIN32
+    pthread_mutex_lock(&mutex_);
+    if (!started_) {
+      pthread_mutex_unlock(&mutex_); return;
+    }
+    stop_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    pthread_join(thread_, NULL);
+    pthread_mutex_lock(&mutex_);
+    started_ = false;
+    pthread_mutex_unlock(&mutex_);
+#endif
+  }
+
+ private:
+#ifndef _WIN32
+  // whether the caller is the progress thread, the caller holds mutex_
+  inline bool InProgressThread(void) const {
+    return started_ && pthread_equal(pthread_self(), thread_);
+  }
+  // wait until request id finishes, the caller holds mutex_,
+  // the progress thread does not wait, as it runs the requests in order
+  inline void WaitLocked(uint64_t id) {
+    if (InProgressThread()) return;
+    while (ndone_ < id) pthread_cond_wait(&cond_, &mutex_);
+  }
+  // main loop of the progress thread
+  inline static void *ThreadMain(void *arg) {
+    AsyncEngine *p = static_cast<AsyncEngine*>(arg);
+    pthread_mutex_lock(&p->mutex_);
+    while (true) {
+      while (p->queue_.empty() && !p->stop_) {
+        pthread_cond_wait(&p->cond_, &p->mutex_);
+      }
+      if (p->queue_.empty()) break;
+      AsyncTask task = p->queue_.front();
+      pthread_mutex_unlock(&p->mutex_);
+      task.Run();
+      pthread_mutex_lock(&p->mutex_);
+      p->queue_.pop_front();
+      ++p->ndone_;
+      pthread_cond_broadcast(&p->cond_);
+    }
+    pthread_mutex_unlock(&p->mutex_);
+    return NULL;
+  }
+  /*! \brief the progress thread */
+  pthread_t thread_;
+  /*! \brief lock and condition of the queue */
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+#endif
+  /*!
+   * \brief whether the progress thread is running, and whether it is asked to stop,
+   *  guarded by mutex_ as the other fields
+   */
+  bool started_, stop_;
+  /*! \brief tasks waiting to be done, the front one is running */
+  std::deque<AsyncTask> queue_;
+  /*! \brief number of requests issued and finished */
+  uint64_t nissued_, ndone_;
+};
+// singleton of non-blocking collectives
+AsyncEngine async;
+
 /*! \brief intiialize the synchronization module */
 void Init(int argc, char *argv[]) {
   for (int i = 1; i < argc; ++i) {
@@ -40,12 +200,19 @@ void Init(int argc, char *argv[]) {
 
 /*! \brief finalize syncrhonization module */
 void Finalize(void) {
+  async.Shutdown();
   manager.Shutdown();
 }
 /*! \brief singleton method to get engine */
 IEngine *GetEngine(void) {
   return &manager;
 }
+/*! \brief singleton method to get engine, after the non-blocking collectives issued finish */
+IEngine *GetIdleEngine(void) {
+  // the progress thread owns the links until the non-blocking collectives finish
+  async.WaitAll();
+  return &manager;
+}
 // perform in-place allreduce, on sendrecvbuf
 void Allreduce_(void *sendrecvbuf,
                 size_t type_nbytes,
@@ -55,8 +222,85 @@ void Allreduce_(void *sendrecvbuf,
                 mpi::OpType op,
                 IEngine::PreprocFunction prepare_fun,
                 void *prepare_arg) {
-  GetEngine()->Allreduce(sendrecvbuf, type_nbytes, count,
-                         red, prepare_fun, prepare_arg);
+  IEngine *engine = GetIdleEngine();
+  // float sum can pass the data in 16 bit format on the wire
+  if (dtype == mpi::kFloat && op == mpi::kSum) {
+    manager.AllreduceSumFloat(static_cast<float*>(sendrecvbuf), count,
+                              red, prepare_fun, prepare_arg);
+    return;
+  }
+  engine->Allreduce(sendrecvbuf, type_nbytes, count,
+                    red, prepare_fun, prepare_arg);
+}
+// start in-place allreduce in the progress thread
+uint64_t IAllreduce_(void *sendrecvbuf,
+                     size_t type_nbytes,
+                     size_t count,
+                     IEngine::ReduceFunction red,
+                     mpi::DataType dtype,
+                     mpi::OpType op,
+                     IEngine::PreprocFunction prepare_fun,
+                     void *prepare_arg) {
+  AsyncTask task;
+  task.allreduce = true;
+  task.buf = sendrecvbuf; task.type_nbytes = type_nbytes; task.count = count;
+  task.red = red; task.dtype = dtype; task.op = op;
+  task.prepare_fun = prepare_fun; task.prepare_arg = prepare_arg;
+  task.root = 0;
+  return async.Push(task);
+}
+// start broadcast in the progress thread
+uint64_t IBroadcast_(void *sendrecv_data, size_t size, int root) {
+  AsyncTask task;
+  task.allreduce = false;
+  task.buf = sendrecv_data; task.type_nbytes = 1; task.count = size;
+  task.red = NULL; task.dtype = mpi::kChar; task.op = mpi::kSum;
+  task.prepare_fun = NULL; task.prepare_arg = NULL;
+  task.root = root;
+  return async.Push(task);
+}
+bool TestRequest_(uint64_t id) {
+  return async.Test(id);
+}
+void WaitRequest_(uint64_t id) {
+  async.Wait(id);
+}
+// perform in-place sparse allreduce, on sendrecvbuf
+void SparseAllreduce_(void *sendrecvbuf,
+                      size_t type_nbytes,
+                      size_t count,
+                      IEngine::ReduceFunction red,
+                      mpi::DataType dtype,
+                      mpi::OpType op,
+                      IEngine::PreprocFunction prepare_fun,
+                      void *prepare_arg) {
+  GetIdleEngine()->SparseAllreduce(sendrecvbuf, type_nbytes, count,
+                                   red, prepare_fun, prepare_arg);
+}
+// perform in-place reduce, on sendrecvbuf
+void Reduce_(void *sendrecvbuf,
+             size_t type_nbytes,
+             size_t count,
+             IEngine::ReduceFunction red,
+             mpi::DataType dtype,
+             mpi::OpType op,
+             int root,
+             IEngine::PreprocFunction prepare_fun,
+             void *prepare_arg) {
+  GetIdleEngine()->Reduce(sendrecvbuf, type_nbytes, count,
+                          red, root, prepare_fun, prepare_arg);
+}
+// perform in-place reduce-scatter, on sendrecvbuf
+void ReduceScatter_(void *sendrecvbuf,
+                    size_t type_nbytes,
+                    const std::vector<size_t> &counts,
+                    IEngine::ReduceFunction red,
+                    mpi::DataType dtype,
+                    mpi::OpType op,
+                    IEngine::PreprocFunction prepare_fun,
+                    void *prepare_arg) {
+  GetIdleEngine()->ReduceScatter(sendrecvbuf, type_nbytes, counts,
+                                 red, prepare_fun, prepare_arg);
 }
 
 // code for reduce handle
@@ -77,8 +321,8 @@ void ReduceHandle::Allreduce(void *sendrecvbuf,
                              IEngine::PreprocFunction prepare_fun,
                              void *prepare_arg) {
   utils::Assert(redfunc_ != NULL, "must intialize handle to call AllReduce");
-  GetEngine()->Allreduce(sendrecvbuf, type_nbytes, count,
-                         redfunc_, prepare_fun, prepare_arg);
+  GetIdleEngine()->Allreduce(sendrecvbuf, type_nbytes, count,
+                             redfunc_, prepare_fun, prepare_arg);
 }
 }  // namespace engine
 }  // namespace rabit
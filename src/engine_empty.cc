@@ -29,8 +29,40 @@ class EmptyEngine : public IEngine {
     utils::Error("EmptyEngine:: Allreduce is not supported,"\
                  "use Allreduce_ instead");
   }
+  virtual void SparseAllreduce(void *sendrecvbuf_,
+                               size_t type_nbytes,
+                               size_t count,
+                               ReduceFunction reducer,
+                               PreprocFunction prepare_fun,
+                               void *prepare_arg) {
+    utils::Error("EmptyEngine:: SparseAllreduce is not supported,"\
+                 "use SparseAllreduce_ instead");
+  }
+  virtual void Reduce(void *sendrecvbuf_,
+                      size_t type_nbytes,
+                      size_t count,
+                      ReduceFunction reducer,
+                      int root,
+                      PreprocFunction prepare_fun,
+                      void *prepare_arg) {
+    utils::Error("EmptyEngine:: Reduce is not supported,"\
+                 "use Reduce_ instead");
+  }
   virtual void Broadcast(void *sendrecvbuf_, size_t size, int root) {
   }
+  virtual void ReduceScatter(void *sendrecvbuf_,
+                             size_t type_nbytes,
+                             const std::vector<size_t> &counts,
+                             ReduceFunction reducer,
+                             PreprocFunction prepare_fun,
+                             void *prepare_arg) {
+    utils::Error("EmptyEngine:: ReduceScatter is not supported,"\
+                 "use ReduceScatter_ instead");
+  }
+  virtual void Allgather(void *sendrecvbuf_, size_t size) {
+  }
+  virtual void Allgatherv(void *sendrecvbuf_, const std::vector<size_t> &sizes) {
+  }
   virtual void InitAfterException(void) {
     utils::Error("EmptyEngine is not fault tolerant");
   }
@@ -83,6 +115,10 @@ void Finalize(void) {
 IEngine *GetEngine(void) {
   return &manager;
 }
+/*! \brief non-blocking collectives finish at once, nothing to wait for */
+IEngine *GetIdleEngine(void) {
+  return &manager;
+}
 // perform in-place allreduce, on sendrecvbuf
 void Allreduce_(void *sendrecvbuf,
                 size_t type_nbytes,
@@ -94,6 +130,61 @@ void Allreduce_(void *sendrecvbuf,
                 void *prepare_arg) {
   if (prepare_fun != NULL) prepare_fun(prepare_arg);
 }
+// perform in-place sparse allreduce, on sendrecvbuf
+void SparseAllreduce_(void *sendrecvbuf,
+                      size_t type_nbytes,
+                      size_t count,
+                      IEngine::ReduceFunction red,
+                      mpi::DataType dtype,
+                      mpi::OpType op,
+                      IEngine::PreprocFunction prepare_fun,
+                      void *prepare_arg) {
+  if (prepare_fun != NULL) prepare_fun(prepare_arg);
+}
+// perform in-place reduce, on sendrecvbuf
+void Reduce_(void *sendrecvbuf,
+             size_t type_nbytes,
+             size_t count,
+             IEngine::ReduceFunction red,
+             mpi::DataType dtype,
+             mpi::OpType op,
+             int root,
+             IEngine::PreprocFunction prepare_fun,
+             void *prepare_arg) {
+  if (prepare_fun != NULL) prepare_fun(prepare_arg);
+}
+// perform in-place reduce-scatter, on sendrecvbuf
+void ReduceScatter_(void *sendrecvbuf,
+                    size_t type_nbytes,
+                    const std::vector<size_t> &counts,
+                    IEngine::ReduceFunction red,
+                    mpi::DataType dtype,
+                    mpi::OpType op,
+                    IEngine::PreprocFunction prepare_fun,
+                    void *prepare_arg) {
+  if (prepare_fun != NULL) prepare_fun(prepare_arg);
+}
+
+// non-blocking collectives are done at the time they are issued
+uint64_t IAllreduce_(void *sendrecvbuf,
+                     size_t type_nbytes,
+                     size_t count,
+                     IEngine::ReduceFunction red,
+                     mpi::DataType dtype,
+                     mpi::OpType op,
+                     IEngine::PreprocFunction prepare_fun,
+                     void *prepare_arg) {
+  if (prepare_fun != NULL) prepare_fun(prepare_arg);
+  return 1;
+}
+uint64_t IBroadcast_(void *sendrecv_data, size_t size, int root) {
+  return 1;
+}
+bool TestRequest_(uint64_t id) {
+  return true;
+}
+void WaitRequest_(uint64_t id) {
+}
 
 // code for reduce handle
 ReduceHandle::ReduceHandle(void) : handle_(NULL), htype_(NULL) {
@@ -11,6 +11,7 @@
 #define NOMINMAX
 #include <mpi.h>
 #include <cstdio>
+#include <cstring>
 #include "../include/rabit/engine.h"
 #include "../include/rabit/utils.h"
 
@@ -31,9 +32,52 @@ class MPIEngine : public IEngine {
     utils::Error("MPIEngine:: Allreduce is not supported,"\
                  "use Allreduce_ instead");
   }
+  virtual void SparseAllreduce(void *sendrecvbuf_,
+                               size_t type_nbytes,
+                               size_t count,
+                               ReduceFunction reducer,
+                               PreprocFunction prepare_fun,
+                               void *prepare_arg) {
+    utils::Error("MPIEngine:: SparseAllreduce is not supported,"\
+                 "use SparseAllreduce_ instead");
+  }
+  virtual void Reduce(void *sendrecvbuf_,
+                      size_t type_nbytes,
+                      size_t count,
+                      ReduceFunction reducer,
+                      int root,
+                      PreprocFunction prepare_fun,
+                      void *prepare_arg) {
+    utils::Error("MPIEngine:: Reduce is not supported,"\
+                 "use Reduce_ instead");
+  }
   virtual void Broadcast(void *sendrecvbuf_, size_t size, int root) {
     MPI::COMM_WORLD.Bcast(sendrecvbuf_, size, MPI::CHAR, root);
   }
+  virtual void ReduceScatter(void *sendrecvbuf_,
+                             size_t type_nbytes,
+                             const std::vector<size_t> &counts,
+                             ReduceFunction reducer,
+                             PreprocFunction prepare_fun,
+                             void *prepare_arg) {
+    utils::Error("MPIEngine:: ReduceScatter is not supported,"\
+                 "use ReduceScatter_ instead");
+  }
+  virtual void Allgather(void *sendrecvbuf_, size_t size) {
+    MPI::COMM_WORLD.Allgather(MPI_IN_PLACE, 0, MPI::CHAR,
+                              sendrecvbuf_, size, MPI::CHAR);
+  }
+  virtual void Allgatherv(void *sendrecvbuf_, const std::vector<size_t> &sizes) {
+    std::vector<int> recvcounts(sizes.size()), displs(sizes.size());
+    int begin = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      recvcounts[i] = static_cast<int>(sizes[i]);
+      displs[i] = begin;
+      begin += recvcounts[i];
+    }
+    MPI::COMM_WORLD.Allgatherv(MPI_IN_PLACE, 0, MPI::CHAR, sendrecvbuf_,
+                               &recvcounts[0], &displs[0], MPI::CHAR);
+  }
   virtual void InitAfterException(void) {
     utils::Error("MPI is not fault tolerant");
   }
@@ -94,6 +138,10 @@ void Finalize(void) {
 IEngine *GetEngine(void) {
   return &manager;
 }
+/*! \brief non-blocking collectives finish at once, nothing to wait for */
+IEngine *GetIdleEngine(void) {
+  return &manager;
+}
 // transform enum to MPI data type
 inline MPI::Datatype GetType(mpi::DataType dtype) {
   using namespace mpi;
@@ -135,6 +183,81 @@ void Allreduce_(void *sendrecvbuf,
   MPI::COMM_WORLD.Allreduce(MPI_IN_PLACE, sendrecvbuf,
                             count, GetType(dtype), GetOp(op));
 }
+// perform in-place sparse allreduce, on sendrecvbuf
+void SparseAllreduce_(void *sendrecvbuf,
+                      size_t type_nbytes,
+                      size_t count,
+                      IEngine::ReduceFunction red,
+                      mpi::DataType dtype,
+                      mpi::OpType op,
+                      IEngine::PreprocFunction prepare_fun,
+                      void *prepare_arg) {
+  Allreduce_(sendrecvbuf, type_nbytes, count, red, dtype, op, prepare_fun, prepare_arg);
+}
+// perform in-place reduce, on sendrecvbuf
+void Reduce_(void *sendrecvbuf,
+             size_t type_nbytes,
+             size_t count,
+             IEngine::ReduceFunction red,
+             mpi::DataType dtype,
+             mpi::OpType op,
+             int root,
+             IEngine::PreprocFunction prepare_fun,
+             void *prepare_arg) {
+  if (prepare_fun != NULL) prepare_fun(prepare_arg);
+  if (MPI::COMM_WORLD.Get_rank() == root) {
+    MPI::COMM_WORLD.Reduce(MPI_IN_PLACE, sendrecvbuf,
+                           count, GetType(dtype), GetOp(op), root);
+  } else {
+    MPI::COMM_WORLD.Reduce(sendrecvbuf, NULL,
+                           count, GetType(dtype), GetOp(op), root);
+  }
+}
+// perform in-place reduce-scatter, on sendrecvbuf
+void ReduceScatter_(void *sendrecvbuf,
+                    size_t type_nbytes,
+                    const std::vector<size_t> &counts,
+                    IEngine::ReduceFunction red,
+                    mpi::DataType dtype,
+                    mpi::OpType op,
+                    IEngine::PreprocFunction prepare_fun,
+                    void *prepare_arg) {
+  if (prepare_fun != NULL) prepare_fun(prepare_arg);
+  const int rank = MPI::COMM_WORLD.Get_rank();
+  std::vector<int> recvcounts(counts.size());
+  size_t begin = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    recvcounts[i] = static_cast<int>(counts[i]);
+    if (i < static_cast<size_t>(rank)) begin += counts[i];
+  }
+  // MPI stores the result at the beginning of the buffer, move it to the block of current rank
+  char *buf = static_cast<char*>(sendrecvbuf);
+  MPI::COMM_WORLD.Reduce_scatter(MPI_IN_PLACE, buf, &recvcounts[0],
+                                 GetType(dtype), GetOp(op));
+  std::memmove(buf + begin * type_nbytes, buf, counts[rank] * type_nbytes);
+}
+
+// non-blocking collectives are done at the time they are issued
+uint64_t IAllreduce_(void *sendrecvbuf,
+                     size_t type_nbytes,
+                     size_t count,
+                     IEngine::ReduceFunction red,
+                     mpi::DataType dtype,
+                     mpi::OpType op,
+                     IEngine::PreprocFunction prepare_fun,
+                     void *prepare_arg) {
+  Allreduce_(sendrecvbuf, type_nbytes, count, red, dtype, op, prepare_fun, prepare_arg);
+  return 1;
+}
+uint64_t IBroadcast_(void *sendrecv_data, size_t size, int root) {
+  GetEngine()->Broadcast(sendrecv_data, size, root);
+  return 1;
+}
+bool TestRequest_(uint64_t id) {
+  return true;
+}
+void WaitRequest_(uint64_t id) {
+}
 
 // code for reduce handle
 ReduceHandle::ReduceHandle(void) 
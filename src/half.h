@@ -0,0 +1,159 @@
+/*!
+ *  Copyright (c) 2014 by Contributors
+ * \file half.h
+ * \brief conversion between 32 bit float and 16 bit floating point formats,
+ *   used to pass float data on the wire with half of the bytes
+ */
+#ifndef RABIT_HALF_H_
+#define RABIT_HALF_H_
+#include <cstring>
+#include "../include/rabit/utils.h"
+#if defined(__F16C__) || defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
+
+namespace rabit {
+namespace utils {
+/*! \brief floating point formats of float data passed on the wire */
+enum FloatFormat {
+  /*! \brief IEEE single precision, no conversion */
+  kFP32,
+  /*! \brief IEEE half precision, 5 bits exponent and 10 bits mantissa */
+  kFP16,
+  /*! \brief bfloat16, the upper half of single precision */
+  kBF16
+};
+/*! \brief convert float to IEEE half precision, round to nearest even */
+inline uint16_t FloatToFP16(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  const uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+  const uint32_t absx = x & 0x7fffffffU;
+  // infinity and NaN, keep NaN quiet
+  if (absx >= 0x7f800000U) {
+    return sign | 0x7c00 | (absx > 0x7f800000U ? 0x200 : 0);
+  }
+  // 65520 and larger round to infinity
+  if (absx >= 0x477ff000U) return sign | 0x7c00;
+  uint32_t r, rem, half;
+  if (absx < 0x38800000U) {
+    // subnormal in half precision, no larger than half of the smallest one rounds to zero
+    if (absx <= 0x33000000U) return sign;
+    const uint32_t shift = 126 - (absx >> 23);
+    const uint32_t m = (absx & 0x7fffffU) | 0x800000U;
+    r = m >> shift;
+    rem = m & ((1U << shift) - 1);
+    half = 1U << (shift - 1);
+  } else {
+    // rebias the exponent from 127 to 15
+    r = (absx - 0x38000000U) >> 13;
+    rem = absx & 0x1fffU;
+    half = 0x1000U;
+  }
+  // the carry of rounding moves into exponent correctly
+  if (rem > half || (rem == half && (r & 1))) ++r;
+  return sign | static_cast<uint16_t>(r);
+}
+/*! \brief convert IEEE half precision to float, which is exact */
+inline float FP16ToFloat(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t e = (h >> 10) & 0x1f, m = h & 0x3ff, x;
+  if (e == 0x1f) {
+    x = sign | 0x7f800000U | (m << 13);
+  } else if (e != 0) {
+    x = sign | ((e + 112) << 23) | (m << 13);
+  } else if (m == 0) {
+    x = sign;
+  } else {
+    // subnormal, normalize the mantissa
+    e = 113;
+    while ((m & 0x400) == 0) {
+      m <<= 1; --e;
+    }
+    x = sign | (e << 23) | ((m & 0x3ff) << 13);
+  }
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+/*! \brief convert float to bfloat16, round to nearest even */
+inline uint16_t FloatToBF16(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  // keep NaN quiet, rounding could turn it into infinity
+  if ((x & 0x7fffffffU) > 0x7f800000U) {
+    return static_cast<uint16_t>((x >> 16) | 0x40);
+  }
+  x += 0x7fffU + ((x >> 16) & 1);
+  return static_cast<uint16_t>(x >> 16);
+}
+/*! \brief convert bfloat16 to float, which is exact */
+inline float BF16ToFloat(uint16_t h) {
+  const uint32_t x = static_cast<uint32_t>(h) << 16;
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+/*!
+ * \brief convert an array of float to 16 bit format,
+ *  uses F16C or AVX512-BF16 instructions when the compiler enables them,
+ *  the latter flushes subnormal input to zero
+ * \param src the float data
+ * \param dst the converted data
+ * \param n number of elements
+ * \param fmt the format to convert to, kFP16 or kBF16
+ */
+inline void FloatToHalf(const float *src, uint16_t *dst, size_t n, FloatFormat fmt) {
+  size_t i = 0;
+  if (fmt == kFP16) {
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+      __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+#endif
+    for (; i < n; ++i) dst[i] = FloatToFP16(src[i]);
+  } else {
+    Assert(fmt == kBF16, "FloatToHalf: invalid format");
+#if defined(__AVX512BF16__)
+    for (; i + 16 <= n; i += 16) {
+      __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), (__m256i)h);  // NOLINT(*)
+    }
+#endif
+    for (; i < n; ++i) dst[i] = FloatToBF16(src[i]);
+  }
+}
+/*!
+ * \brief convert an array of 16 bit format to float,
+ *  uses F16C or AVX512-BF16 instructions when the compiler enables them
+ * \param src the data in 16 bit format
+ * \param dst the float data
+ * \param n number of elements
+ * \param fmt the format to convert from, kFP16 or kBF16
+ */
+inline void HalfToFloat(const uint16_t *src, float *dst, size_t n, FloatFormat fmt) {
+  size_t i = 0;
+  if (fmt == kFP16) {
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+      __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < n; ++i) dst[i] = FP16ToFloat(src[i]);
+  } else {
+    Assert(fmt == kBF16, "HalfToFloat: invalid format");
+#if defined(__AVX512BF16__)
+    for (; i + 16 <= n; i += 16) {
+      __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      __m512i x = _mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16);
+      _mm512_storeu_ps(dst + i, _mm512_castsi512_ps(x));
+    }
+#endif
+    for (; i < n; ++i) dst[i] = BF16ToFloat(src[i]);
+  }
+}
+}  // namespace utils
+}  // namespace rabit
+#endif  // RABIT_HALF_H_
@@ -0,0 +1,255 @@
+/*!
+ *  Copyright (c) 2014 by Contributors
+ * \file shm.h
+ * \brief shared memory channel between two processes in the same host,
+ *   the channel contains two ring buffers, one for each direction
+ */
+#ifndef RABIT_SHM_H_
+#define RABIT_SHM_H_
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include "../include/rabit/utils.h"
+
+namespace rabit {
+namespace utils {
+/*!
+ * \brief shared memory channel, each side writes to one ring buffer and reads from the other,
+ *  every ring buffer has a single writer and a single reader, so no lock is needed.
+ *  The channel does not block, the owner is responsible to notify the other side
+ *  when Read or Write tells the other side is waiting
+ */
+class ShmChannel {
+ public:
+  /*!
+   * \brief create a new shared memory segment, the creator writes to ring 0
+   * \param tag string put in the name of segment to tell the use of it
+   * \param capacity size of each ring buffer in bytes
+   * \return the channel, NULL if the segment cannot be created
+   */
+  inline static ShmChannel *Create(const std::string &tag, size_t capacity) {
+#if !defined(_WIN32)
+    static unsigned counter = 0;
+    char name[128];
+    snprintf(name, sizeof(name), "/rabit.%d.%s.%u",
+             static_cast<int>(getpid()), tag.c_str(), counter++);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) return NULL;
+    const size_t size = sizeof(Header) + capacity * 2;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      close(fd); shm_unlink(name); return NULL;
+    }
+    ShmChannel *ch = Map(fd, size, 0);
+    if (ch == NULL) {
+      shm_unlink(name); return NULL;
+    }
+    ch->name_ = name;
+    // the nonce only needs to differ between segments of the same name in different hosts
+    ch->header_->nonce = (static_cast<uint64_t>(getpid()) << 32) ^
+        static_cast<uint64_t>(time(NULL)) ^ (static_cast<uint64_t>(counter) << 48) ^
+        static_cast<uint64_t>(reinterpret_cast<size_t>(ch->header_));
+    ch->header_->capacity = capacity;
+    return ch;
+#else
+    return NULL;
+#endif
+  }
+  /*!
+   * \brief open the segment created by the other side, the opener writes to ring 1
+   * \param name name of the segment
+   * \param capacity size of each ring buffer in bytes
+   * \param nonce the nonce given by the creator
+   * \return the channel, NULL if the segment cannot be opened or does not match
+   */
+  inline static ShmChannel *Open(const std::string &name, size_t capacity, uint64_t nonce) {
+#if !defined(_WIN32)
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd == -1) return NULL;
+    const size_t size = sizeof(Header) + capacity * 2;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != size) {
+      close(fd); return NULL;
+    }
+    ShmChannel *ch = Map(fd, size, 1);
+    if (ch == NULL) return NULL;
+    if (ch->header_->nonce != nonce || ch->header_->capacity != capacity) {
+      delete ch; return NULL;
+    }
+    return ch;
+#else
+    return NULL;
+#endif
+  }
+  ~ShmChannel(void) {
+#if !defined(_WIN32)
+    this->Unlink();
+    munmap(header_, size_);
+#endif
+  }
+  /*! \return name of the segment, used by the other side to open it */
+  inline const std::string &Name(void) const {
+    return name_;
+  }
+  /*! \return the nonce, used by the other side to check the segment */
+  inline uint64_t Nonce(void) const {
+    return header_->nonce;
+  }
+  /*!
+   * \brief remove the name of the segment, the memory is kept until both sides unmap it,
+   *  called by the creator once the other side opens the segment
+   */
+  inline void Unlink(void) {
+#if !defined(_WIN32)
+    if (name_.length() != 0) {
+      shm_unlink(name_.c_str()); name_.clear();
+    }
+#endif
+  }
+  /*!
+   * \brief write data into the ring buffer to the other side
+   * \param buf_ the data to be written
+   * \param len size of the data
+   * \param notify set to true if the other side waits for data and need to be notified
+   * \return number of bytes written, 0 if the ring buffer is full
+   */
+  inline size_t Write(const void *buf_, size_t len, bool *notify) {
+    const char *buf = reinterpret_cast<const char*>(buf_);
+    Ring &r = header_->ring[side_];
+    const uint64_t head = r.head;
+    const size_t n = std::min(len, static_cast<size_t>(capacity_ - (head - r.tail)));
+    if (n == 0) return 0;
+    const size_t start = static_cast<size_t>(head % capacity_);
+    const size_t n1 = std::min(n, capacity_ - start);
+    char *data = data_[side_];
+    memcpy(data + start, buf, n1);
+    memcpy(data, buf + n1, n - n1);
+    // data must be visible before the head moves
+    __sync_synchronize();
+    r.head = head + n;
+    __sync_synchronize();
+    if (r.wait_read != 0) {
+      r.wait_read = 0; *notify = true;
+    }
+    return n;
+  }
+  /*!
+   * \brief read data from the ring buffer from the other side
+   * \param buf_ the buffer to store the data
+   * \param len maximum size to read
+   * \param notify set to true if the other side waits for space and need to be notified
+   * \return number of bytes read, 0 if the ring buffer is empty
+   */
+  inline size_t Read(void *buf_, size_t len, bool *notify) {
+    char *buf = reinterpret_cast<char*>(buf_);
+    Ring &r = header_->ring[1 - side_];
+    const uint64_t tail = r.tail;
+    const size_t n = std::min(len, static_cast<size_t>(r.head - tail));
+    if (n == 0) return 0;
+    __sync_synchronize();
+    const size_t start = static_cast<size_t>(tail % capacity_);
+    const size_t n1 = std::min(n, capacity_ - start);
+    const char *data = data_[1 - side_];
+    memcpy(buf, data + start, n1);
+    memcpy(buf + n1, data, n - n1);
+    // finish reading before the space is given back
+    __sync_synchronize();
+    r.tail = tail + n;
+    __sync_synchronize();
+    if (r.wait_write != 0) {
+      r.wait_write = 0; *notify = true;
+    }
+    return n;
+  }
+  /*! \return whether there is data to read */
+  inline bool CanRead(void) const {
+    const Ring &r = header_->ring[1 - side_];
+    return r.head != r.tail;
+  }
+  /*! \return whether there is space to write */
+  inline bool CanWrite(void) const {
+    const Ring &r = header_->ring[side_];
+    return r.head - r.tail != capacity_;
+  }
+  /*!
+   * \brief tell the other side that we are going to wait for data
+   * \return whether data is already there, in which case there is no need to wait
+   */
+  inline bool PrepareWaitRead(void) {
+    header_->ring[1 - side_].wait_read = 1;
+    __sync_synchronize();
+    return this->CanRead();
+  }
+  /*!
+   * \brief tell the other side that we are going to wait for space
+   * \return whether space is already there, in which case there is no need to wait
+   */
+  inline bool PrepareWaitWrite(void) {
+    header_->ring[side_].wait_write = 1;
+    __sync_synchronize();
+    return this->CanWrite();
+  }
+
+ private:
+  /*! \brief state of one ring buffer, fields written by different sides are in different cache lines */
+  struct Ring {
+    // total bytes written, only changed by the writer
+    volatile uint64_t head;
+    char pad0[56];
+    // total bytes read, only changed by the reader
+    volatile uint64_t tail;
+    char pad1[56];
+    // set by the reader before it waits for data
+    volatile int wait_read;
+    char pad2[60];
+    // set by the writer before it waits for space
+    volatile int wait_write;
+    char pad3[60];
+  };
+  /*! \brief header at the beginning of the segment, followed by data of two ring buffers */
+  struct Header {
+    uint64_t nonce;
+    uint64_t capacity;
+    char pad[48];
+    Ring ring[2];
+  };
+  ShmChannel(void) {}
+#if !defined(_WIN32)
+  inline static ShmChannel *Map(int fd, size_t size, int side) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return NULL;
+    ShmChannel *ch = new ShmChannel();
+    ch->header_ = reinterpret_cast<Header*>(ptr);
+    ch->size_ = size;
+    ch->side_ = side;
+    ch->capacity_ = (size - sizeof(Header)) / 2;
+    char *data = reinterpret_cast<char*>(ptr) + sizeof(Header);
+    ch->data_[0] = data;
+    ch->data_[1] = data + ch->capacity_;
+    return ch;
+  }
+#endif
+  // mapped segment
+  Header *header_;
+  // size of the segment
+  size_t size_;
+  // the ring buffer this side writes to, the other one is read by this side
+  int side_;
+  // size of each ring buffer
+  size_t capacity_;
+  // data of the two ring buffers
+  char *data_[2];
+  // name of the segment, empty if it is already unlinked or this side is not the creator
+  std::string name_;
+};
+}  // namespace utils
+}  // namespace rabit
+#endif  // RABIT_SHM_H_
@@ -19,13 +19,25 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/select.h>
 #include <sys/ioctl.h>
+#include <sched.h>
+#endif
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/epoll.h>
 #endif
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include "../include/rabit/utils.h"
+#include "../include/rabit/timer.h"
+#include "./shm.h"
 
 #if defined(_WIN32)
 typedef int ssize_t;
@@ -245,16 +257,92 @@ class TCPSocket : public Socket{
       Socket::Error("SetKeepAlive");
     }
   }
+  /*!
+   * \brief enable/disable Nagle's algorithm,
+   *  small messages are sent out immediately when nodelay is on
+   * \param nodelay whether to set the TCP_NODELAY option on
+   */
+  inline void SetNoDelay(bool nodelay) {
+    int opt = static_cast<int>(nodelay);
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char*>(&opt), sizeof(opt)) < 0) {
+      Socket::Error("SetNoDelay");
+    }
+  }
   /*!
    * \brief create the socket, call this before using socket
    * \param af domain
    */
   inline void Create(int af = PF_INET) {
-    sockfd = socket(PF_INET, SOCK_STREAM, 0);
+    sockfd = socket(af, SOCK_STREAM, 0);
     if (sockfd == INVALID_SOCKET) {
       Socket::Error("Create");
     }
   }
+  /*!
+   * \brief bind the socket created with AF_UNIX to a path in the directory,
+   *  the path is only visible to the processes in the same host
+   * \param dir the directory to put the path in
+   * \param tag number put in the path to tell different sockets of the same process
+   * \return the path successfully bind to, empty string if failed
+   */
+  inline std::string TryBindUnix(const std::string &dir, int tag) {
+#if !defined(_WIN32)
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    char name[64];
+    snprintf(name, sizeof(name), "/rabit.%d.%d.sock", static_cast<int>(getpid()), tag);
+    std::string path = dir + name;
+    if (path.length() >= sizeof(addr.sun_path)) return std::string();
+    strcpy(addr.sun_path, path.c_str());  // NOLINT(*)
+    // remove the path left by a dead process with the same pid
+    unlink(path.c_str());
+    if (bind(sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+      return path;
+    }
+#endif
+    return std::string();
+  }
+  /*!
+   * \brief connect the socket created with AF_UNIX to a path
+   * \param path the path the other side binds to
+   * \return whether connect is successful
+   */
+  inline bool ConnectUnix(const std::string &path) {
+#if !defined(_WIN32)
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path.c_str());  // NOLINT(*)
+    return connect(sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+#else
+    return false;
+#endif
+  }
+  /*!
+   * \brief close the socket bound by TryBindUnix and remove the path
+   * \param path the path returned by TryBindUnix
+   */
+  inline void CloseUnix(const std::string &path) {
+    this->Close();
+#if !defined(_WIN32)
+    unlink(path.c_str());
+#endif
+  }
+  /*! \return whether the socket is a unix domain socket, which does not take TCP options */
+  inline bool IsUnix(void) const {
+#if !defined(_WIN32)
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(sockfd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+      Socket::Error("IsUnix");
+    }
+    return addr.ss_family == AF_UNIX;
+#else
+    return false;
+#endif
+  }
   /*!
    * \brief perform listen of the socket
    * \param backlog backlog parameter
@@ -390,6 +478,98 @@ class TCPSocket : public Socket{
   }
 };
 
+/*!
+ * \brief socket of a link to another node, when both nodes are in the same host,
+ *  the data can be passed through shared memory instead, in which case the TCP socket
+ *  is kept to notify the other side, to detect closed connection and to send Out-of-Band message
+ */
+class LinkSocket : public TCPSocket {
+ public:
+  /*! \brief shared memory channel, NULL if the data goes through TCP */
+  ShmChannel *shm;
+  // constructor
+  LinkSocket(void) : shm(NULL), peer_closed_(false) {
+  }
+  LinkSocket(const TCPSocket &sock) : TCPSocket(sock), shm(NULL), peer_closed_(false) {
+  }
+  /*!
+   * \brief pass the data through shared memory channel from now on,
+   *  the link takes the ownership of the channel
+   * \param ch the channel
+   */
+  inline void AttachShm(ShmChannel *ch) {
+    shm = ch; peer_closed_ = false;
+  }
+  /*!
+   * \brief send data using the link, same as TCPSocket::Send,
+   *  Out-of-Band message always goes through TCP
+   */
+  inline ssize_t Send(const void *buf_, size_t len, int flag = 0) {
+    if (shm == NULL || (flag & MSG_OOB) != 0) return TCPSocket::Send(buf_, len, flag);
+    this->Drain();
+    if (peer_closed_) {
+      errno = ECONNRESET; return -1;
+    }
+    bool notify = false;
+    size_t n = shm->Write(buf_, len, &notify);
+    if (notify) this->Notify();
+    if (n == 0) {
+      errno = EAGAIN; return -1;
+    }
+    return static_cast<ssize_t>(n);
+  }
+  /*!
+   * \brief receive data using the link, same as TCPSocket::Recv,
+   *  return 0 when the other side closed the connection
+   */
+  inline ssize_t Recv(void *buf_, size_t len, int flags = 0) {
+    if (shm == NULL) return TCPSocket::Recv(buf_, len, flags);
+    this->Drain();
+    bool notify = false;
+    size_t n = shm->Read(buf_, len, &notify);
+    if (notify) this->Notify();
+    if (n == 0) {
+      if (peer_closed_) return 0;
+      errno = EAGAIN; return -1;
+    }
+    return static_cast<ssize_t>(n);
+  }
+  /*! \brief close the link, release the shared memory */
+  inline void Close(void) {
+    if (shm != NULL) {
+      delete shm; shm = NULL;
+    }
+    TCPSocket::Close();
+  }
+
+ private:
+  // whether the other side has closed the TCP connection
+  bool peer_closed_;
+  // wake up the other side waiting on the TCP socket
+  inline void Notify(void) {
+    char sig = 0;
+#ifdef MSG_NOSIGNAL
+    TCPSocket::Send(&sig, sizeof(sig), MSG_NOSIGNAL);
+#else
+    TCPSocket::Send(&sig, sizeof(sig));
+#endif
+  }
+  // discard the notifications from the other side, and detect closed connection
+  inline void Drain(void) {
+    char buf[64];
+    while (true) {
+      ssize_t len = TCPSocket::Recv(buf, sizeof(buf));
+      if (len > 0) continue;
+      if (len == 0) {
+        peer_closed_ = true;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        peer_closed_ = true;
+      }
+      return;
+    }
+  }
+};
+
 /*! \brief helper data structure to perform select */
 struct SelectHelper {
  public:
@@ -398,6 +578,7 @@ struct SelectHelper {
     FD_ZERO(&write_set);
     FD_ZERO(&except_set);
     maxfd = 0;
+    ready = false;
   }
   /*!
    * \brief add file descriptor to watch for read 
@@ -423,6 +604,43 @@ struct SelectHelper {
     FD_SET(fd, &except_set);
     if (fd > maxfd) maxfd = fd;
   }
+  /*!
+   * \brief watch the link for read, a link using shared memory
+   *  is woken up by notification from the TCP socket
+   * \param sock the link to be watched
+   */
+  inline void WatchRead(LinkSocket &sock) {
+    if (sock.shm != NULL && sock.shm->PrepareWaitRead()) ready = true;
+    this->WatchRead(static_cast<SOCKET>(sock));
+  }
+  /*!
+   * \brief watch the link for write, a link using shared memory
+   *  is woken up by notification from the TCP socket
+   * \param sock the link to be watched
+   */
+  inline void WatchWrite(LinkSocket &sock) {
+    if (sock.shm == NULL) {
+      this->WatchWrite(static_cast<SOCKET>(sock)); return;
+    }
+    if (sock.shm->PrepareWaitWrite()) ready = true;
+    this->WatchRead(static_cast<SOCKET>(sock));
+  }
+  /*!
+   * \brief Check if the link is ready for read
+   * \param sock the link to check status
+   */
+  inline bool CheckRead(const LinkSocket &sock) const {
+    if (sock.shm != NULL && sock.shm->CanRead()) return true;
+    return this->CheckRead(static_cast<SOCKET>(sock));
+  }
+  /*!
+   * \brief Check if the link is ready for write
+   * \param sock the link to check status
+   */
+  inline bool CheckWrite(const LinkSocket &sock) const {
+    if (sock.shm != NULL) return sock.shm->CanWrite();
+    return this->CheckWrite(static_cast<SOCKET>(sock));
+  }
   /*!
    * \brief Check if the descriptor is ready for read
    * \param fd file descriptor to check status
@@ -451,6 +669,12 @@ struct SelectHelper {
    * \return 1 if success, 0 if timeout, and -1 if error occurs
    */
   inline static int WaitExcept(SOCKET fd, long timeout = 0) {
+#if defined(__linux__)
+    // poll has no limit on the value of descriptor
+    pollfd pfd;
+    pfd.fd = fd; pfd.events = POLLPRI; pfd.revents = 0;
+    return poll(&pfd, 1, timeout == 0 ? -1 : (timeout < 0 ? 0 : static_cast<int>(timeout)));
+#endif
     fd_set wait_set;
     FD_ZERO(&wait_set);
     FD_SET(fd, &wait_set);
@@ -462,11 +686,14 @@ struct SelectHelper {
    * \param select_read whether to watch for read event
    * \param select_write whether to watch for write event
    * \param select_except whether to watch for exception event
-   * \param timeout specify timeout in micro-seconds(ms) if equals 0, means select will always block
+   * \param timeout specify timeout in micro-seconds(ms) if equals 0, means select will always block,
+   *        negative value means select returns immediately
    * \return number of active descriptors selected, 
    *         return -1 if error occurs
    */
   inline int Select(long timeout = 0) {
+    // some link is already ready, only poll the descriptors
+    if (ready) timeout = -1;
     int ret =  Select_(static_cast<int>(maxfd + 1),
                        &read_set, &write_set, &except_set, timeout);
     if (ret == -1) {
@@ -483,6 +710,10 @@ struct SelectHelper {
 #endif
     if (timeout == 0) {
       return select(maxfd, rfds, wfds, efds, NULL);
+    } else if (timeout < 0) {
+      timeval tm;
+      tm.tv_usec = 0; tm.tv_sec = 0;
+      return select(maxfd, rfds, wfds, efds, &tm);
     } else {
       timeval tm;
       tm.tv_usec = (timeout % 1000) * 1000;
@@ -493,7 +724,326 @@ struct SelectHelper {
 
   SOCKET maxfd;
   fd_set read_set, write_set, except_set;
+  // whether some link using shared memory is ready without waiting
+  bool ready;
+};
+
+/*!
+ * \brief spin-then-block policy of waiting for the links, the waiter polls without blocking
+ *  for a bounded time before it blocks, which saves the wake up by scheduler for quick replies,
+ *  the counters tell whether the CPU spent on spinning pays off.
+ *  Spinning only polls the readiness of the links, by epoll or select with zero timeout
+ *  or by peeking the completion queue of io_uring, it does not try non-blocking recv or send,
+ *  the data is still moved by the caller after the wait returns
+ */
+struct BusyPoll {
+  /*! \brief micro-seconds to spin before blocking, 0 means block at once */
+  long spin_us;
+  /*! \brief number of waits finished while spinning */
+  uint64_t nspin;
+  /*! \brief number of waits that blocked after spinning */
+  uint64_t nblock;
+  /*! \brief seconds spent in spinning */
+  double tspin;
+  BusyPoll(void) : spin_us(0), nspin(0), nblock(0), tspin(0.0) {}
+  /*!
+   * \brief whether to keep spinning
+   * \param tstart the time spinning started
+   */
+  inline bool Spinning(double tstart) const {
+#ifndef _WIN32
+    // let the other processes in the same core run, which spinning would otherwise delay
+    sched_yield();
+#endif
+    return GetTime() - tstart < spin_us * 1e-6;
+  }
+  /*!
+   * \brief count a wait that finished spinning
+   * \param tstart the time spinning started
+   * \param ready whether some link became ready while spinning
+   */
+  inline void Count(double tstart, bool ready) {
+    tspin += GetTime() - tstart;
+    if (ready) {
+      ++nspin;
+    } else {
+      ++nblock;
+    }
+  }
 };
+
+#if defined(__linux__)
+/*!
+ * \brief helper to wait for events of the links, with the same interface as SelectHelper,
+ *  it is kept by the engine across the rounds of waiting, the descriptors are registered
+ *  to epoll once, and only the events that changed since the last round are updated,
+ *  so each round costs in the number of links watched instead of the largest descriptor
+ */
+class PollHelper {
+ public:
+  PollHelper(void) : epfd_(-1), ready_(false), busy_(NULL) {}
+  ~PollHelper(void) {
+    if (epfd_ != -1) close(epfd_);
+  }
+  /*!
+   * \brief start a new round of waiting, clear the watched events
+   * \return reference to itself
+   */
+  inline PollHelper &Begin(void) {
+    for (size_t i = 0; i < watched_.size(); ++i) {
+      fds_[watched_[i]].watch = 0;
+      fds_[watched_[i]].revents = 0;
+    }
+    watched_.clear();
+    ready_ = false;
+    return *this;
+  }
+  /*!
+   * \brief forget all the registered descriptors, call this when the links are connected again,
+   *  as the number of a closed descriptor can be reused by a new link
+   */
+  inline void Reset(void) {
+    if (epfd_ != -1) close(epfd_);
+    epfd_ = -1;
+    fds_.clear(); watched_.clear(); active_.clear();
+    ready_ = false;
+  }
+  /*!
+   * \brief spin before blocking in Select, the policy is kept by caller across Reset
+   * \param busy the policy and counters of spinning, NULL to always block
+   */
+  inline void SetBusyPoll(BusyPoll *busy) {
+    busy_ = busy;
+  }
+  /*!
+   * \brief add file descriptor to watch for read
+   * \param fd file descriptor to be watched
+   */
+  inline void WatchRead(SOCKET fd) {
+    this->Watch(fd, EPOLLIN);
+  }
+  /*!
+   * \brief add file descriptor to watch for write
+   * \param fd file descriptor to be watched
+   */
+  inline void WatchWrite(SOCKET fd) {
+    this->Watch(fd, EPOLLOUT);
+  }
+  /*!
+   * \brief add file descriptor to watch for exception, which is out of band data
+   * \param fd file descriptor to be watched
+   */
+  inline void WatchException(SOCKET fd) {
+    this->Watch(fd, EPOLLPRI);
+  }
+  /*!
+   * \brief watch the link for read, see SelectHelper::WatchRead
+   * \param sock the link to be watched
+   */
+  inline void WatchRead(LinkSocket &sock) {
+    if (sock.shm != NULL && sock.shm->PrepareWaitRead()) ready_ = true;
+    this->WatchRead(static_cast<SOCKET>(sock));
+  }
+  /*!
+   * \brief watch the link for write, see SelectHelper::WatchWrite
+   * \param sock the link to be watched
+   */
+  inline void WatchWrite(LinkSocket &sock) {
+    if (sock.shm == NULL) {
+      this->WatchWrite(static_cast<SOCKET>(sock)); return;
+    }
+    if (sock.shm->PrepareWaitWrite()) ready_ = true;
+    this->WatchRead(static_cast<SOCKET>(sock));
+  }
+  /*!
+   * \brief Check if the link is ready for read
+   * \param sock the link to check status
+   */
+  inline bool CheckRead(const LinkSocket &sock) const {
+    if (sock.shm != NULL && sock.shm->CanRead()) return true;
+    return this->CheckRead(static_cast<SOCKET>(sock));
+  }
+  /*!
+   * \brief Check if the link is ready for write
+   * \param sock the link to check status
+   */
+  inline bool CheckWrite(const LinkSocket &sock) const {
+    if (sock.shm != NULL) return sock.shm->CanWrite();
+    return this->CheckWrite(static_cast<SOCKET>(sock));
+  }
+  /*!
+   * \brief Check if the descriptor is ready for read,
+   *  error and hang up count as ready, as in select
+   * \param fd file descriptor to check status
+   */
+  inline bool CheckRead(SOCKET fd) const {
+    return this->Check(fd, EPOLLIN, EPOLLIN | EPOLLERR | EPOLLHUP);
+  }
+  /*!
+   * \brief Check if the descriptor is ready for write
+   * \param fd file descriptor to check status
+   */
+  inline bool CheckWrite(SOCKET fd) const {
+    return this->Check(fd, EPOLLOUT, EPOLLOUT | EPOLLERR | EPOLLHUP);
+  }
+  /*!
+   * \brief Check if the descriptor has any exception
+   * \param fd file descriptor to check status
+   */
+  inline bool CheckExcept(SOCKET fd) const {
+    return this->Check(fd, EPOLLPRI, EPOLLPRI);
+  }
+  /*!
+   * \brief wait for the events watched in this round
+   * \param timeout specify timeout in micro-seconds(ms) if equals 0, means select will always block,
+   *        negative value means select returns immediately
+   * \return number of active descriptors, return -1 if error occurs
+   */
+  inline int Select(long timeout = 0) {
+    if (epfd_ == -1) {
+      epfd_ = epoll_create(64);
+      if (epfd_ == -1) Socket::Error("epoll_create");
+    }
+    // stop the events of descriptors that are no longer watched
+    for (size_t i = 0; i < active_.size(); ++i) {
+      FdState &st = fds_[active_[i]];
+      if (st.watch == 0 && st.events != 0) {
+        epoll_event ev;
+        ev.events = 0; ev.data.fd = active_[i];
+        // the descriptor can already be closed, which removes it from epoll
+        if (epoll_ctl(epfd_, EPOLL_CTL_MOD, active_[i], &ev) != 0) st.registered = false;
+        st.events = 0;
+      }
+    }
+    active_ = watched_;
+    for (size_t i = 0; i < watched_.size(); ++i) {
+      const int fd = watched_[i];
+      FdState &st = fds_[fd];
+      if (st.registered && st.events == st.watch) continue;
+      epoll_event ev;
+      ev.events = st.watch; ev.data.fd = fd;
+      // a closed descriptor leaves epoll, its number can be reused by a new link
+      int ret = epoll_ctl(epfd_, st.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+      if (ret != 0 && (errno == ENOENT || errno == EEXIST)) {
+        ret = epoll_ctl(epfd_, errno == ENOENT ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+      }
+      if (ret != 0) Socket::Error("epoll_ctl");
+      st.registered = true;
+      st.events = st.watch;
+    }
+    // some link is already ready, only poll the descriptors
+    const int wait_ms = ready_ ? 0 :
+        (timeout == 0 ? -1 : (timeout < 0 ? 0 : static_cast<int>(timeout)));
+    events_.resize(std::max(watched_.size(), static_cast<size_t>(1)));
+    int ret = 0;
+    if (wait_ms == -1 && busy_ != NULL && busy_->spin_us > 0) {
+      const double tstart = GetTime();
+      do {
+        ret = this->Wait(0);
+      } while (ret == 0 && busy_->Spinning(tstart));
+      busy_->Count(tstart, ret != 0);
+    }
+    if (ret == 0) ret = this->Wait(wait_ms);
+    for (int i = 0; i < ret; ++i) {
+      fds_[events_[i].data.fd].revents = events_[i].events;
+    }
+    return ret;
+  }
+
+ private:
+  /*! \brief state of a descriptor */
+  struct FdState {
+    /*! \brief events watched in this round, events registered in epoll, events got */
+    uint32_t watch, events, revents;
+    /*! \brief whether the descriptor is in epoll */
+    bool registered;
+    FdState(void) : watch(0), events(0), revents(0), registered(false) {}
+  };
+  // wait for events in epoll, the events are put in events_
+  inline int Wait(int wait_ms) {
+    int ret;
+    do {
+      ret = epoll_wait(epfd_, &events_[0], static_cast<int>(events_.size()), wait_ms);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) Socket::Error("Select");
+    return ret;
+  }
+  // add events to watch
+  inline void Watch(SOCKET fd, uint32_t events) {
+    utils::Assert(fd >= 0, "PollHelper: invalid descriptor");
+    if (static_cast<size_t>(fd) >= fds_.size()) fds_.resize(fd + 1);
+    if (fds_[fd].watch == 0) watched_.push_back(fd);
+    fds_[fd].watch |= events;
+  }
+  // check events of descriptor, only when it is watched for the event
+  inline bool Check(SOCKET fd, uint32_t watch, uint32_t events) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= fds_.size()) return false;
+    const FdState &st = fds_[fd];
+    return (st.watch & watch) != 0 && (st.revents & events) != 0;
+  }
+  /*! \brief the epoll descriptor */
+  int epfd_;
+  /*! \brief whether some link using shared memory is ready without waiting */
+  bool ready_;
+  /*! \brief state of descriptors, indexed by descriptor */
+  std::vector<FdState> fds_;
+  /*! \brief descriptors watched in this round, and descriptors with events registered */
+  std::vector<int> watched_, active_;
+  /*! \brief buffer of events returned by epoll */
+  std::vector<epoll_event> events_;
+  /*! \brief policy of spinning before blocking, can be NULL */
+  BusyPoll *busy_;
+};
+#else
+/*! \brief without epoll, the sets of select are built again in each round */
+struct PollHelper : public SelectHelper {
+  PollHelper(void) : busy_(NULL) {}
+  /*!
+   * \brief start a new round of waiting, clear the watched events
+   * \return reference to itself
+   */
+  inline PollHelper &Begin(void) {
+    static_cast<SelectHelper&>(*this) = SelectHelper();
+    return *this;
+  }
+  /*! \brief forget all the registered descriptors, nothing to do for select */
+  inline void Reset(void) {}
+  /*!
+   * \brief spin before blocking in Select
+   * \param busy the policy and counters of spinning, NULL to always block
+   */
+  inline void SetBusyPoll(BusyPoll *busy) {
+    busy_ = busy;
+  }
+  /*!
+   * \brief wait for the events watched in this round, see SelectHelper::Select
+   * \param timeout specify timeout in micro-seconds(ms) if equals 0, means select will always block
+   * \return number of active descriptors, return -1 if error occurs
+   */
+  inline int Select(long timeout = 0) {
+    if (timeout == 0 && !ready && busy_ != NULL && busy_->spin_us > 0) {
+      // select overwrites the sets, so each try polls a copy of them
+      SelectHelper probe;
+      int ret;
+      const double tstart = GetTime();
+      do {
+        probe = *this;
+        ret = probe.SelectHelper::Select(-1);
+      } while (ret == 0 && busy_->Spinning(tstart));
+      busy_->Count(tstart, ret != 0);
+      if (ret != 0) {
+        static_cast<SelectHelper&>(*this) = probe;
+        return ret;
+      }
+    }
+    return SelectHelper::Select(timeout);
+  }
+
+ private:
+  /*! \brief policy of spinning before blocking, can be NULL */
+  BusyPoll *busy_;
+};
+#endif
 }  // namespace utils
 }  // namespace rabit
 #endif  // RABIT_SOCKET_H_
@@ -0,0 +1,222 @@
+/*!
+ *  Copyright (c) 2014 by Contributors
+ * \file uring.h
+ * \brief minimal wrapper of Linux io_uring through raw system calls,
+ *   used to keep socket operations of the links in flight and reap their completions in batch
+ */
+#ifndef RABIT_URING_H_
+#define RABIT_URING_H_
+#include "../include/rabit/utils.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RABIT_USE_URING 1
+#endif
+#endif
+
+#ifdef RABIT_USE_URING
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace rabit {
+namespace utils {
+#ifdef RABIT_USE_URING
+/*!
+ * \brief a submission and completion queue pair of io_uring,
+ *  operations are queued by Prep*, and passed to kernel by Submit
+ */
+class URing {
+ public:
+  URing(void) : fd_(-1), nqueued_(0) {}
+  ~URing(void) {
+    this->Close();
+  }
+  /*!
+   * \brief create the queues
+   * \param entries number of entries of submission queue
+   * \return false if io_uring or the operations needed are not supported by the kernel
+   */
+  inline bool Init(unsigned entries) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0) {
+      fd_ = -1; return false;
+    }
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    sq_ptr_ = mmap(NULL, sq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    cq_ptr_ = single_mmap ? sq_ptr_ :
+        mmap(NULL, cq_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED) {
+      if (sq_ptr_ == MAP_FAILED) sq_ptr_ = NULL;
+      if (cq_ptr_ == MAP_FAILED) cq_ptr_ = NULL;
+      sqes_ = sqes == MAP_FAILED ? NULL : static_cast<io_uring_sqe*>(sqes);
+      this->Close(); return false;
+    }
+    char *sq = static_cast<char*>(sq_ptr_), *cq = static_cast<char*>(cq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    nqueued_ = 0;
+    // check the operations we need, probe is available since the same kernel as send and recv
+    std::vector<char> probe_buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe*>(&probe_buf[0]);
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+      this->Close(); return false;
+    }
+    const int ops[4] = {IORING_OP_RECV, IORING_OP_SEND, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL};
+    for (int i = 0; i < 4; ++i) {
+      if (ops[i] > probe->last_op || (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED) == 0) {
+        this->Close(); return false;
+      }
+    }
+    return true;
+  }
+  /*! \brief release the queues */
+  inline void Close(void) {
+    if (fd_ == -1) return;
+    if (sqes_ != NULL) munmap(sqes_, sqes_size_);
+    if (cq_ptr_ != NULL && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_ != NULL) munmap(sq_ptr_, sq_size_);
+    close(fd_);
+    fd_ = -1; sqes_ = NULL; sq_ptr_ = cq_ptr_ = NULL;
+  }
+  /*! \return whether the queues are created */
+  inline bool IsOpen(void) const {
+    return fd_ != -1;
+  }
+  /*! \return number of entries of submission queue */
+  inline unsigned Capacity(void) const {
+    return sq_entries_;
+  }
+  /*! \brief queue receiving from fd into buf */
+  inline void PrepRecv(int fd, void *buf, size_t len, uint64_t data) {
+    io_uring_sqe *sqe = this->NextSQE(IORING_OP_RECV, fd, data);
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+  }
+  /*! \brief queue sending buf to fd */
+  inline void PrepSend(int fd, const void *buf, size_t len, uint64_t data) {
+    io_uring_sqe *sqe = this->NextSQE(IORING_OP_SEND, fd, data);
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+  }
+  /*! \brief queue waiting for the events of fd */
+  inline void PrepPoll(int fd, short events, uint64_t data) {
+    io_uring_sqe *sqe = this->NextSQE(IORING_OP_POLL_ADD, fd, data);
+    sqe->poll_events = static_cast<uint16_t>(events);
+  }
+  /*! \brief queue cancelling the operation with user data target */
+  inline void PrepCancel(uint64_t target, uint64_t data) {
+    io_uring_sqe *sqe = this->NextSQE(IORING_OP_ASYNC_CANCEL, -1, data);
+    sqe->addr = target;
+  }
+  /*!
+   * \brief submit the queued operations, and wait for completions
+   * \param wait_nr number of completions to wait for
+   */
+  inline void Submit(unsigned wait_nr) {
+    while (true) {
+      int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, nqueued_, wait_nr,
+                                         wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0));
+      if (ret >= 0) {
+        nqueued_ -= static_cast<unsigned>(ret);
+        if (nqueued_ == 0) return;
+      } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        Error("io_uring_enter error: %s", strerror(errno));
+      }
+    }
+  }
+  /*! \return whether some completion can be reaped without waiting */
+  inline bool Ready(void) const {
+    return *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  }
+  /*!
+   * \brief get the next completion
+   * \param data user data of the operation
+   * \param res result of the operation, negative errno on failure
+   * \return false if there is no completion
+   */
+  inline bool Reap(uint64_t *data, int *res) {
+    const unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return false;
+    const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+    *data = cqe.user_data;
+    *res = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  // get a cleared entry of submission queue
+  inline io_uring_sqe *NextSQE(int opcode, int fd, uint64_t data) {
+    const unsigned tail = *sq_tail_;
+    Assert(tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) < sq_entries_,
+           "URing: submission queue is full");
+    io_uring_sqe *sqe = &sqes_[tail & sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = static_cast<uint8_t>(opcode);
+    sqe->fd = fd;
+    sqe->user_data = data;
+    sq_array_[tail & sq_mask_] = tail & sq_mask_;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++nqueued_;
+    return sqe;
+  }
+  /*! \brief descriptor of io_uring */
+  int fd_;
+  /*! \brief number of entries queued but not submitted */
+  unsigned nqueued_;
+  /*! \brief mapped memory of the queues */
+  void *sq_ptr_, *cq_ptr_;
+  size_t sq_size_, cq_size_, sqes_size_;
+  /*! \brief fields of submission queue */
+  unsigned *sq_head_, *sq_tail_, *sq_array_, sq_mask_, sq_entries_;
+  io_uring_sqe *sqes_;
+  /*! \brief fields of completion queue */
+  unsigned *cq_head_, *cq_tail_, cq_mask_;
+  io_uring_cqe *cqes_;
+};
+#else
+/*! \brief io_uring is not available, Init always fails */
+class URing {
+ public:
+  inline bool Init(unsigned entries) { return false; }
+  inline void Close(void) {}
+  inline bool IsOpen(void) const { return false; }
+  inline unsigned Capacity(void) const { return 0; }
+  inline void PrepRecv(int fd, void *buf, size_t len, uint64_t data) {}
+  inline void PrepSend(int fd, const void *buf, size_t len, uint64_t data) {}
+  inline void PrepPoll(int fd, short events, uint64_t data) {}
+  inline void PrepCancel(uint64_t target, uint64_t data) {}
+  inline void Submit(unsigned wait_nr) {}
+  inline bool Ready(void) const { return false; }
+  inline bool Reap(uint64_t *data, int *res) { return false; }
+};
+#endif  // RABIT_USE_URING
+}  // namespace utils
+}  // namespace rabit
+#endif  // RABIT_URING_H_
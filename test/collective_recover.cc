@@ -0,0 +1,299 @@
+// this is a test case to test whether rabit can recover the results of
+// collective operations besides Allreduce and Broadcast when facing an exception,
+// including ReduceScatter, SparseAllreduce, Reduce, Allgather, AllreduceBatch
+// and the non-blocking IAllreduce and IBroadcast
+#include <rabit.h>
+#include <rabit/utils.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+using namespace rabit;
+
+// dummy model
+class Model : public rabit::ISerializable {
+ public:
+  // iterations
+  std::vector<float> data;
+  // load from stream
+  virtual void Load(rabit::IStream &fi) {
+    fi.Read(&data);
+  }
+  /*! \brief save the model to the stream */
+  virtual void Save(rabit::IStream &fo) const {
+    fo.Write(data);
+  }
+  virtual void InitModel(size_t n) {
+    data.clear();
+    data.resize(n, 1.0f);
+  }
+};
+
+inline void TestReduceScatter(Model *model, int ntrial, int iter) {
+  int rank = rabit::GetRank();
+  int nproc = rabit::GetWorldSize();
+  const int z = iter + 121;
+  // blocks of different size, some of them can be empty
+  std::vector<size_t> counts(nproc);
+  size_t n = model->data.size(), begin = 0;
+  for (int r = 0; r < nproc; ++r) {
+    counts[r] = std::min(n, (n / nproc) * (r % 3) / 2 + r % 2);
+    n -= counts[r];
+    if (r < rank) begin += counts[r];
+  }
+  counts[nproc - 1] += n;
+
+  std::vector<float> ndata(model->data.size());
+  for (size_t i = 0; i < ndata.size(); ++i) {
+    ndata[i] = (i * (rank+1)) % z + model->data[i];
+  }
+  rabit::ReduceScatter<op::Sum>(&ndata[0], counts);
+
+  for (size_t i = begin; i < begin + counts[rank]; ++i) {
+    float rsum = model->data[i] * nproc;
+    for (int r = 0; r < nproc; ++r) {
+      rsum += (float)((i * (r+1)) % z);
+    }
+    utils::Check(fabsf(rsum - ndata[i]) < 1e-5,
+                 "[%d] TestReduceScatter check failure, local=%g, reducescatter=%g",
+                 rank, rsum, ndata[i]);
+  }
+  // only keep the result in current block, so that model stays the same in all nodes
+  for (size_t i = begin; i < begin + counts[rank]; ++i) {
+    model->data[i] += 1.0f;
+  }
+  rabit::Allreduce<op::Max>(&model->data[0], model->data.size());
+}
+
+// value of element i in a node for TestSparseAllreduce, most of them are zero
+inline float SparseValue(const Model &model, int rank, size_t i) {
+  // the first quarter of node 0 is dense
+  if ((i * 7 + rank) % 13 == 0 || (rank == 0 && i < model.data.size() / 4)) {
+    return model.data[i] + rank + 1;
+  }
+  return 0.0f;
+}
+
+inline void TestSparseAllreduce(Model *model, int ntrial, int iter) {
+  int rank = rabit::GetRank();
+  int nproc = rabit::GetWorldSize();
+  std::vector<float> ndata(model->data.size());
+  for (size_t i = 0; i < ndata.size(); ++i) {
+    ndata[i] = SparseValue(*model, rank, i);
+  }
+  rabit::SparseAllreduce<op::Sum>(&ndata[0], ndata.size());
+  for (size_t i = 0; i < ndata.size(); ++i) {
+    float rsum = 0.0f;
+    for (int r = 0; r < nproc; ++r) {
+      rsum += SparseValue(*model, r, i);
+    }
+    utils::Check(fabsf(rsum - ndata[i]) < 1e-5 * (1.0f + fabsf(rsum)),
+                 "[%d] TestSparseAllreduce check failure, local=%g, allreduce=%g",
+                 rank, rsum, ndata[i]);
+  }
+  for (size_t i = 0; i < ndata.size(); ++i) {
+    if (ndata[i] != 0.0f) model->data[i] += 1.0f;
+  }
+}
+
+inline void TestReduce(Model *model, int ntrial, int iter) {
+  int rank = rabit::GetRank();
+  int nproc = rabit::GetWorldSize();
+  const int z = iter + 111;
+  // reduce to root 0 and to a root moving with the iteration
+  int roots[2] = {0, (iter * 3 + 1) % nproc};
+  for (int k = 0; k < 2; ++k) {
+    std::vector<float> ndata(model->data.size());
+    for (size_t i = 0; i < ndata.size(); ++i) {
+      ndata[i] = (i * (rank+1)) % z + model->data[i];
+    }
+    rabit::Reduce<op::Max>(&ndata[0], ndata.size(), roots[k]);
+    if (rank != roots[k]) continue;
+    for (size_t i = 0; i < ndata.size(); ++i) {
+      float rmax = (i * 1) % z + model->data[i];
+      for (int r = 0; r < nproc; ++r) {
+        rmax = std::max(rmax, (i * (r+1)) % z + model->data[i]);
+      }
+      utils::Check(rmax == ndata[i], "[%d] TestReduce check failure, root=%d", rank, roots[k]);
+    }
+  }
+}
+
+inline void TestAllgather(Model *model, int ntrial, int iter) {
+  int rank = rabit::GetRank();
+  int nproc = rabit::GetWorldSize();
+  const size_t n = model->data.size();
+  // each node contributes different number of elements, some of them can be empty
+  std::vector<float> ndata((rank * 7 + iter) % (n / nproc + 2));
+  for (size_t i = 0; i < ndata.size(); ++i) {
+    ndata[i] = model->data[i % n] + rank * 1000 + i;
+  }
+  std::vector<size_t> counts;
+  rabit::Allgatherv(&ndata, &counts);
+  utils::Check(counts.size() == static_cast<size_t>(nproc),
+               "[%d] TestAllgather counts size check", rank);
+  size_t begin = 0;
+  for (int r = 0; r < nproc; ++r) {
+    utils::Check(counts[r] == (r * 7 + iter) % (n / nproc + 2),
+                 "[%d] TestAllgather count check failure, rank=%d", rank, r);
+    for (size_t i = 0; i < counts[r]; ++i) {
+      float res = model->data[i % n] + r * 1000 + i;
+      utils::Check(fabsf(res - ndata[begin + i]) < 1e-5,
+                   "[%d] TestAllgather check failure, local=%g, allgather=%g",
+                   rank, res, ndata[begin + i]);
+    }
+    begin += counts[r];
+  }
+  utils::Check(begin == ndata.size(), "[%d] TestAllgather size check", rank);
+  // the gathered result is the same in all nodes
+  for (size_t i = 0; i < n; ++i) {
+    model->data[i] += static_cast<float>(ndata.size() % 3);
+  }
+}
+
+inline void TestAllreduceBatch(Model *model, int ntrial, int iter) {
+  int rank = rabit::GetRank();
+  int nproc = rabit::GetWorldSize();
+  const int z = iter + 131;
+  const size_t n = model->data.size();
+  // buffers of different types and operators in one batch
+  std::vector<float> fsum(n), fsum2(n / 3 + 1);
+  int imax = rank * 17 + iter;
+  double dsum[3] = {rank + 0.5, -1.0 * rank, 1.0};
+  for (size_t i = 0; i < fsum.size(); ++i) {
+    fsum[i] = (i * (rank+1)) % z + model->data[i];
+  }
+  for (size_t i = 0; i < fsum2.size(); ++i) {
+    fsum2[i] = static_cast<float>((i + rank) % z);
+  }
+  rabit::AllreduceBatch batch;
+  batch.Add<op::Sum>(&fsum[0], fsum.size());
+  batch.Add<op::Max>(&imax, 1);
+  batch.Add<op::Sum>(dsum, 3);
+  batch.Add<op::Sum>(&fsum2[0], fsum2.size());
+  batch.Run();
+  utils::Check(imax == (nproc - 1) * 17 + iter, "[%d] TestAllreduceBatch max check failure", rank);
+  utils::Check(fabs(dsum[0] - nproc * nproc * 0.5) < 1e-9 &&
+               fabs(dsum[1] + nproc * (nproc - 1) * 0.5) < 1e-9 && dsum[2] == nproc,
+               "[%d] TestAllreduceBatch double sum check failure", rank);
+  for (size_t i = 0; i < fsum.size(); ++i) {
+    float rsum = model->data[i] * nproc;
+    for (int r = 0; r < nproc; ++r) {
+      rsum += (float)((i * (r+1)) % z);
+    }
+    utils::Check(fabsf(rsum - fsum[i]) < 1e-5,
+                 "[%d] TestAllreduceBatch check failure, local=%g, allreduce=%g", rank, rsum, fsum[i]);
+  }
+  for (size_t i = 0; i < fsum2.size(); ++i) {
+    float rsum = 0.0f;
+    for (int r = 0; r < nproc; ++r) {
+      rsum += (float)((i + r) % z);
+    }
+    utils::Check(fabsf(rsum - fsum2[i]) < 1e-5, "[%d] TestAllreduceBatch check failure", rank);
+  }
+  // buffers of the same type are reduced as one array
+  float a = rank + 1.0f, b = 2.0f;
+  batch.Add<op::Sum>(&a, 1);
+  batch.Add<op::Sum>(&b, 1);
+  batch.Run();
+  utils::Check(a == nproc * (nproc + 1) / 2 && b == 2 * nproc,
+               "[%d] TestAllreduceBatch same type check failure", rank);
+  for (size_t i = 0; i < n; ++i) {
+    model->data[i] += 1.0f;
+  }
+}
+
+// lazy prepare function of TestNonBlocking
+struct PrepareSum {
+  const Model *model;
+  std::vector<float> *data;
+  int rank, z;
+  inline static void Run(void *arg) {
+    PrepareSum *p = static_cast<PrepareSum*>(arg);
+    for (size_t i = 0; i < p->data->size(); ++i) {
+      (*p->data)[i] = (i * (p->rank+1)) % p->z + p->model->data[i];
+    }
+  }
+};
+
+inline void TestNonBlocking(Model *model, int ntrial, int iter) {
+  int rank = rabit::GetRank();
+  int nproc = rabit::GetWorldSize();
+  const int z = iter + 141;
+  const size_t n = model->data.size();
+  std::vector<float> dmax(n), dsum(n);
+  for (size_t i = 0; i < n; ++i) {
+    dmax[i] = (i * (rank+1)) % z + model->data[i];
+  }
+  const int root = (iter * 5 + 2) % nproc;
+  std::string msg(n % 97 + 10, ' '), expect = msg;
+  for (size_t i = 0; i < msg.length(); ++i) {
+    expect[i] = 'a' + (i * 3 + root + iter) % 26;
+  }
+  if (rank == root) msg = expect;
+  PrepareSum prep;
+  prep.model = model; prep.data = &dsum; prep.rank = rank; prep.z = z;
+  // the requests are done in the order they are issued
+  Request rmax = rabit::IAllreduce<op::Max>(&dmax[0], n);
+  Request rbcast = rabit::IBroadcast(&msg[0], msg.length(), root);
+  Request rsum = rabit::IAllreduce<op::Sum>(&dsum[0], n, PrepareSum::Run, &prep);
+  // compute the expected result while the data is passed around
+  std::vector<float> emax(n), esum(n);
+  for (size_t i = 0; i < n; ++i) {
+    emax[i] = model->data[i];
+    esum[i] = model->data[i] * nproc;
+    for (int r = 0; r < nproc; ++r) {
+      emax[i] = std::max(emax[i], (i * (r+1)) % z + model->data[i]);
+      esum[i] += (float)((i * (r+1)) % z);
+    }
+  }
+  rsum.Wait();
+  utils::Check(rmax.Test() && rbcast.Test() && rsum.Test(),
+               "[%d] TestNonBlocking requests must finish in order", rank);
+  utils::Check(msg == expect, "[%d] TestNonBlocking broadcast check failure", rank);
+  for (size_t i = 0; i < n; ++i) {
+    utils::Check(emax[i] == dmax[i], "[%d] TestNonBlocking max check failure", rank);
+    utils::Check(fabsf(esum[i] - dsum[i]) < 1e-5,
+                 "[%d] TestNonBlocking check failure, local=%g, allreduce=%g", rank, esum[i], dsum[i]);
+  }
+  // requests left unfinished are waited by the next call to rabit
+  rabit::IAllreduce<op::Max>(&model->data[0], n);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printf("Usage: <ndata> <config>\n");
+    return 0;
+  }
+  int n = atoi(argv[1]);
+  rabit::Init(argc, argv);
+  int rank = rabit::GetRank();
+  Model model;
+  int ntrial = 0;
+  for (int i = 1; i < argc; ++i) {
+    int n;
+    if (sscanf(argv[i], "rabit_num_trial=%d", &n) == 1) ntrial = n;
+  }
+  int iter = rabit::LoadCheckPoint(&model);
+  if (iter == 0) {
+    model.InitModel(n);
+  }
+  printf("[%d] reload-trail=%d, init iter=%d\n", rank, ntrial, iter);
+  for (int r = iter; r < 3; ++r) {
+    TestReduceScatter(&model, ntrial, r);
+    printf("[%d] !!!TestReduceScatter pass, iter=%d\n", rank, r);
+    TestSparseAllreduce(&model, ntrial, r);
+    printf("[%d] !!!TestSparseAllreduce pass, iter=%d\n", rank, r);
+    TestReduce(&model, ntrial, r);
+    printf("[%d] !!!TestReduce pass, iter=%d\n", rank, r);
+    TestAllgather(&model, ntrial, r);
+    printf("[%d] !!!TestAllgather pass, iter=%d\n", rank, r);
+    TestAllreduceBatch(&model, ntrial, r);
+    printf("[%d] !!!TestAllreduceBatch pass, iter=%d\n", rank, r);
+    TestNonBlocking(&model, ntrial, r);
+    printf("[%d] !!!TestNonBlocking pass, iter=%d\n", rank, r);
+    rabit::CheckPoint(&model);
+    printf("[%d] !!!CheckPont pass, iter=%d\n", rank, r);
+  }
+  rabit::Finalize();
+  return 0;
+}
@@ -52,12 +52,15 @@ inline void TestBcast(size_t n, int root) {
 
 inline void PrintStats(const char *name, double tdiff, int n, int nrep, size_t size) {
   int nproc = rabit::GetWorldSize();
-  double tsum = tdiff;
-  rabit::Allreduce<op::Sum>(&tsum, 1);
+  // the time of all the nodes in one collective
+  std::vector<double> times(nproc);
+  times[rabit::GetRank()] = tdiff;
+  rabit::Allgather(&times[0], 1);
+  double tsum = 0.0;
+  for (int i = 0; i < nproc; ++i) tsum += times[i];
   double tavg = tsum / nproc;
-  double tsqr = tdiff - tavg;
-  tsqr *= tsqr;
-  rabit::Allreduce<op::Sum>(&tsqr, 1);
+  double tsqr = 0.0;
+  for (int i = 0; i < nproc; ++i) tsqr += (times[i] - tavg) * (times[i] - tavg);
   double tstd = sqrt(tsqr / nproc);
   if (rabit::GetRank() == 0) {
     rabit::TrackerPrintf("%s: mean=%g, std=%g sec\n", name, tavg, tstd);
@@ -12,7 +12,6 @@ import os
 import socket
 import struct
 import subprocess
-import random
 from threading import Thread
 
 """
@@ -54,7 +53,12 @@ class SlaveEntry:
         slave.sendint(kMagic)
         self.rank = slave.recvint()
         self.world_size = slave.recvint()
+        self.tree_arity = slave.recvint()
+        # whether the node uses double binary tree and hierarchical allreduce
+        self.need_dtree = slave.recvint()
+        self.need_hier = slave.recvint()
         self.jobid = slave.recvstr()
+        self.zone = slave.recvstr()
         self.cmd = slave.recvstr()
 
     def decide_rank(self, job_map):
@@ -64,7 +68,12 @@ class SlaveEntry:
             return job_map[self.jobid]
         return -1
 
-    def assign_rank(self, rank, wait_conn, tree_map, parent_map, ring_map):
+    def same_task(self, other):
+        if self.rank >= 0 and self.rank == other.rank:
+            return True
+        return self.jobid != 'NULL' and self.jobid == other.jobid
+
+    def assign_rank(self, rank, wait_conn, tree_map, parent_map, ring_map, hd_map, dtree_map, hier_map, host_map):
         self.rank = rank
         nnset = set(tree_map[rank])
         rprev, rnext = ring_map[rank]
@@ -89,6 +98,34 @@ class SlaveEntry:
             self.sock.sendint(rnext)
         else:
             self.sock.sendint(-1)
+        # send peers of recursive halving and doubling
+        self.sock.sendint(len(hd_map[rank]))
+        for r in hd_map[rank]:
+            nnset.add(r)
+            self.sock.sendint(r)
+        # send parent of every node, so that the tree can be rooted at any node
+        for r in range(len(tree_map)):
+            self.sock.sendint(parent_map[r])
+        # send parent and neighbors in the two trees of double binary tree
+        self.sock.sendint(len(dtree_map))
+        for dtree, dparent in dtree_map:
+            self.sock.sendint(dparent[rank])
+            self.sock.sendint(len(dtree[rank]))
+            for r in dtree[rank]:
+                nnset.add(r)
+                self.sock.sendint(r)
+        # send parent and neighbors in the tree of hierarchical allreduce
+        hparent, hneighbors = hier_map[rank]
+        self.sock.sendint(hparent)
+        self.sock.sendint(len(hneighbors))
+        for r in hneighbors:
+            nnset.add(r)
+            self.sock.sendint(r)
+        # send neighbors in the same host, links to them can pass data through shared memory
+        local = [r for r in nnset if host_map.get(r) == self.host]
+        self.sock.sendint(len(local))
+        for r in local:
+            self.sock.sendint(r)
         while True:
             ngood = self.sock.recvint()
             goodset = set([])
@@ -105,11 +142,17 @@ class SlaveEntry:
             for r in conset:
                 self.sock.sendstr(wait_conn[r].host)
                 self.sock.sendint(wait_conn[r].port)
-                self.sock.sendint(r)        
+                self.sock.sendint(r)
+                # unix domain socket can only be reached in the same host
+                if wait_conn[r].host == self.host:
+                    self.sock.sendstr(wait_conn[r].unix_path)
+                else:
+                    self.sock.sendstr('')
             nerr = self.sock.recvint()
             if nerr != 0:
                 continue
             self.port = self.sock.recvint()
+            self.unix_path = self.sock.recvstr()
             rmset = []
             # all connection was successuly setup
             for r in conset:
@@ -135,6 +178,8 @@ class Tracker:
         self.sock = sock
         self.verbose = verbose
         self.hostIP = hostIP
+        # table of auto tuning in text format, empty until rank 0 gives it
+        self.tune_table = ''
         self.log_print('start listen on %s:%d' % (socket.gethostname(), self.port), 1)
     def __del__(self):
         self.sock.close()
@@ -147,22 +192,26 @@ class Tracker:
             host = self.hostIP
         return ['rabit_tracker_uri=%s' % host,
                 'rabit_tracker_port=%s' % self.port]        
-    def get_neighbor(self, rank, nslave):
-        rank = rank + 1
+    def get_neighbor(self, rank, nslave, arity = 2):
+        """
+        get the neighbors of rank in a heap shaped tree,
+        where each node has at most arity childs
+        """
         ret = []
-        if rank > 1:
-            ret.append(rank / 2 - 1)
-        if rank * 2 - 1  < nslave:
-            ret.append(rank * 2 - 1)            
-        if rank * 2 < nslave:
-            ret.append(rank * 2)
+        if rank > 0:
+            ret.append((rank - 1) / arity)
+        for r in range(rank * arity + 1, min(rank * arity + arity + 1, nslave)):
+            ret.append(r)
         return ret
-    def get_tree(self, nslave):
+    def get_tree(self, nslave, arity = 2):
         tree_map = {}
         parent_map = {}
         for r in range(nslave):
-            tree_map[r] = self.get_neighbor(r, nslave)
-            parent_map[r] = (r + 1) / 2 - 1
+            tree_map[r] = self.get_neighbor(r, nslave, arity)
+            if r > 0:
+                parent_map[r] = (r - 1) / arity
+            else:
+                parent_map[r] = -1
         return tree_map, parent_map
     def find_share_ring(self, tree_map, parent_map, r):
         """
@@ -196,6 +245,126 @@ class Tracker:
             rnext = (r + 1) % nslave            
             ring_map[rlst[r]] = (rlst[rprev], rlst[rnext])
         return ring_map
+    def get_link_map(self, nslave, arity = 2):
+        """
+        get the link map, this is a bit hacky, call for better algorithm
+        to place similar nodes together
+        the ranks are relabeled so that rank r+1 is the next node of rank r in the ring,
+        ring based collectives in the slaves rely on this property
+        """
+        tree_map, parent_map = self.get_tree(nslave, arity)
+        ring_map = self.get_ring(tree_map, parent_map)
+        rmap = {0 : 0}
+        k = 0
+        for i in range(nslave - 1):
+            k = ring_map[k][1]
+            rmap[k] = i + 1
+
+        ring_map_ = {}
+        tree_map_ = {}
+        parent_map_ = {}
+        for k, v in ring_map.items():
+            ring_map_[rmap[k]] = (rmap[v[0]], rmap[v[1]])
+        for k, v in tree_map.items():
+            tree_map_[rmap[k]] = [rmap[x] for x in v]
+        for k, v in parent_map.items():
+            if k != 0:
+                parent_map_[rmap[k]] = rmap[v]
+            else:
+                parent_map_[rmap[k]] = -1
+        return tree_map_, parent_map_, ring_map_
+    def get_hd_peers(self, rank, nslave):
+        """
+        get the peers used by recursive halving and doubling,
+        when nslave is not power of 2, the first peer pairs up the extra nodes,
+        followed by the peer in each round of recursive halving
+        """
+        nproc = 1
+        while nproc * 2 <= nslave:
+            nproc *= 2
+        nextra = nslave - nproc
+        ret = []
+        if rank < 2 * nextra:
+            if rank % 2 == 0:
+                return [rank + 1]
+            ret.append(rank - 1)
+            vrank = rank / 2
+        else:
+            vrank = rank - nextra
+        mask = nproc / 2
+        while mask >= 1:
+            vpeer = vrank ^ mask
+            if vpeer < nextra:
+                ret.append(vpeer * 2 + 1)
+            else:
+                ret.append(vpeer + nextra)
+            mask /= 2
+        return ret
+    def get_hd_map(self, nslave):
+        """
+        get peers of recursive halving and doubling for all the nodes
+        """
+        hd_map = {}
+        for r in range(nslave):
+            hd_map[r] = self.get_hd_peers(r, nslave)
+        return hd_map
+    def get_btree_parent(self, rank, nslave):
+        """
+        get the parent in a binary tree where all the odd ranks are leaves,
+        rank 0 is the root and has only one child
+        """
+        if rank == 0:
+            return -1
+        bit = rank & (-rank)
+        parent = (rank ^ bit) | (bit << 1)
+        if parent >= nslave:
+            parent = rank ^ bit
+        return parent
+    def get_dtree_map(self, nslave):
+        """
+        get the two trees of double binary tree allreduce, as a list of (tree_map, parent_map),
+        the interior nodes of the first tree are leaves in the second one, and the two trees
+        do not share any link, so that each of them can carry half of the data concurrently,
+        return empty list if no such pair is found, which happens for nslave < 6
+        """
+        if nslave < 2:
+            return []
+        parent_a = [self.get_btree_parent(r, nslave) for r in range(nslave)]
+        edges_a = set([(min(r, p), max(r, p)) for r, p in enumerate(parent_a) if p != -1])
+        odds = range(1, nslave, 2)
+        evens = range(0, nslave, 2)
+        nextra = len(evens) - len(odds)
+        for t in range(len(evens)):
+            # relabel the first tree: its interior nodes(even ranks) take the odd ranks,
+            # the extra interior node when nslave is odd and the leaves take the even ranks
+            ev = evens[t:] + evens[:t]
+            interior = odds + ev[len(ev) - nextra:]
+            leaves = ev[:len(ev) - nextra]
+            relabel = {}
+            for k in range(len(evens)):
+                relabel[evens[k]] = interior[k]
+            for k in range(len(odds)):
+                relabel[odds[k]] = leaves[k]
+            parent_b = [-1] * nslave
+            for r in range(nslave):
+                if parent_a[r] != -1:
+                    parent_b[relabel[r]] = relabel[parent_a[r]]
+            edges_b = set([(min(r, p), max(r, p)) for r, p in enumerate(parent_b) if p != -1])
+            if len(edges_a & edges_b) != 0:
+                continue
+            dtree_map = []
+            for parent in [parent_a, parent_b]:
+                tree = {}
+                dparent = {}
+                for r in range(nslave):
+                    tree[r] = [parent[r]] if parent[r] != -1 else []
+                    dparent[r] = parent[r]
+                for r in range(nslave):
+                    if parent[r] != -1:
+                        tree[parent[r]].append(r)
+                dtree_map.append((tree, dparent))
+            return dtree_map
+        return []
     def handle_print(self,slave, msg):
         sys.stdout.write(msg)
     def log_print(self, msg, level):
@@ -204,6 +373,50 @@ class Tracker:
                 sys.stderr.write(msg + '\n')
         else:
             sys.stderr.write(msg + '\n')
+    def get_empty_hier_map(self, nslave):
+        """
+        get the map of hierarchical allreduce when it is not used, no node has any link in it
+        """
+        hier_map = {}
+        for r in range(nslave):
+            hier_map[r] = (-1, [])
+        return hier_map
+    def get_hier_map(self, locations, arity):
+        """
+        get the tree used by hierarchical allreduce, given location of each rank,
+        nodes in the same location are linked to the leader of the location, which is the smallest rank,
+        and the leaders are linked by a tree, so only the links between leaders go across locations
+        return map from rank to (parent, neighbors)
+        """
+        groups = {}
+        for r in range(len(locations)):
+            groups.setdefault(locations[r], []).append(r)
+        leaders = sorted([min(g) for g in groups.values()])
+        tree_map, parent_map = self.get_tree(len(leaders), arity)
+        hier_map = {}
+        for i in range(len(leaders)):
+            if parent_map[i] != -1:
+                parent = leaders[parent_map[i]]
+            else:
+                parent = -1
+            hier_map[leaders[i]] = (parent, [leaders[x] for x in tree_map[i]])
+        for g in groups.values():
+            leader = min(g)
+            for r in g:
+                if r != leader:
+                    hier_map[r] = (leader, [leader])
+                    hier_map[leader][1].append(r)
+        return hier_map
+    def start_slave(self, s, rank, wait_conn, tree_map, parent_map, ring_map, hd_map, dtree_map, hier_map, host_map):
+        host_map[rank] = s.host
+        s.assign_rank(rank, wait_conn, tree_map, parent_map, ring_map, hd_map, dtree_map, hier_map, host_map)
+        s.sock.sendstr(self.tune_table)
+        if s.cmd != 'start':
+            self.log_print('Recieve %s signal from %d' % (s.cmd, s.rank), 1)
+        else:
+            self.log_print('Recieve %s signal from %s; assign rank %d' % (s.cmd, s.host, s.rank), 1)
+        if s.wait_accept > 0:
+            wait_conn[rank] = s
     def accept_slaves(self, nslave):
         # set of nodes that finishs the job
         shutdown = {}
@@ -215,6 +428,10 @@ class Tracker:
         pending = []
         # lazy initialize tree_map
         tree_map = None
+        # tree of hierarchical allreduce, initialized when all the nodes are started
+        hier_map = None
+        # maps rank to the host of the node
+        host_map = {}
         
         while len(shutdown) != nslave:
             fd, s_addr = self.sock.accept()
@@ -223,6 +440,10 @@ class Tracker:
                 msg = s.sock.recvstr()
                 self.handle_print(s, msg)
                 continue                
+            if s.cmd == 'tune':
+                # table of auto tuning made at start, given to the nodes restarted later
+                self.tune_table = s.sock.recvstr()
+                continue
             if s.cmd == 'shutdown':
                 assert s.rank >= 0 and s.rank not in shutdown
                 assert s.rank not in wait_conn
@@ -235,30 +456,61 @@ class Tracker:
                 assert s.cmd == 'start'
                 if s.world_size > 0:
                     nslave = s.world_size
-                tree_map, parent_map = self.get_tree(nslave)
-                ring_map = self.get_ring(tree_map, parent_map)
-                # set of nodes that is pending for getting up
+                tree_arity = s.tree_arity
+                need_dtree = s.need_dtree
+                need_hier = s.need_hier
+                tree_map, parent_map, ring_map = self.get_link_map(nslave, tree_arity)
+                hd_map = self.get_hd_map(nslave)
+                # links of double binary tree and hierarchical allreduce are only set up when the job
+                # uses them, as each of them costs a connection, and shared memory if in the same host
+                if need_dtree != 0:
+                    dtree_map = self.get_dtree_map(nslave)
+                else:
+                    dtree_map = []
+                # set of nodes that is pending for getting up, the ranks are numbered along the ring,
+                # and each subtree of the tree covers consecutive ranks, so nodes sorted by location
+                # take consecutive ranks to keep the links in the ring and tree within the host
                 todo_nodes = range(nslave)
-                random.shuffle(todo_nodes)
             else:
                 assert s.world_size == -1 or s.world_size == nslave
+                assert s.tree_arity == tree_arity, 'rabit_tree_arity must be the same in all nodes'
+                assert s.need_dtree == need_dtree, 'rabit_double_tree and rabit_autotune must be the same in all nodes'
+                assert s.need_hier == need_hier, 'rabit_hierarchical and rabit_autotune must be the same in all nodes'
             if s.cmd == 'recover':
                 assert s.rank >= 0
             rank = s.decide_rank(job_map)
-            if rank == -1:
-                assert len(todo_nodes) != 0
-                rank = todo_nodes.pop(0)
-                if s.jobid != 'NULL':
-                    job_map[s.jobid] = rank
-                if len(todo_nodes) == 0:
-                    self.log_print('@tracker All of %d nodes getting started' % nslave, 2)
-            s.assign_rank(rank, wait_conn, tree_map, parent_map, ring_map)
-            if s.cmd != 'start':                
-                self.log_print('Recieve %s signal from %d' % (s.cmd, s.rank), 1)
-            else:
-                self.log_print('Recieve %s signal from %s; assign rank %d' % (s.cmd, s.host, s.rank), 1)
-            if s.wait_accept > 0:
-                wait_conn[rank] = s
+            if hier_map == None:
+                # delay the rank assignment until all the nodes are started,
+                # so that nodes in the same zone and host can get adjacent ranks
+                assert s.cmd == 'start'
+                pending = [p for p in pending if not p.same_task(s)]
+                pending.append(s)
+                if len(pending) != nslave:
+                    continue
+                self.log_print('@tracker All of %d nodes getting started' % nslave, 2)
+                locations = [None] * nslave
+                for p in pending:
+                    if p.rank >= 0:
+                        todo_nodes.remove(p.rank)
+                pending.sort(key = lambda x : (x.zone, x.host))
+                for p in pending:
+                    if p.rank < 0:
+                        p.rank = todo_nodes.pop(0)
+                        if p.jobid != 'NULL':
+                            job_map[p.jobid] = p.rank
+                    locations[p.rank] = (p.zone, p.host)
+                if need_hier != 0:
+                    hier_map = self.get_hier_map(locations, tree_arity)
+                else:
+                    hier_map = self.get_empty_hier_map(nslave)
+                for p in pending:
+                    host_map[p.rank] = p.host
+                for p in pending:
+                    self.start_slave(p, p.rank, wait_conn, tree_map, parent_map, ring_map, hd_map, dtree_map, hier_map, host_map)
+                pending = []
+                continue
+            assert rank != -1, 'cannot decide rank of the node'
+            self.start_slave(s, rank, wait_conn, tree_map, parent_map, ring_map, hd_map, dtree_map, hier_map, host_map)
         self.log_print('@tracker All nodes finishes job', 2)
 
 def submit(nslave, args, fun_submit, verbose, hostIP):
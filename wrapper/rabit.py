@@ -87,7 +87,7 @@ def get_world_size():
     """
     Returns get total number of process
     """
-    ret = rbtlib.RabitGetWorlSize()
+    ret = rbtlib.RabitGetWorldSize()
     check_err__()
     return ret
 
@@ -216,6 +216,54 @@ def allreduce(data, op, prepare_fun = None):
     return buf
 
 
+def allgather(data):
+    """
+    gather data from all the nodes, this function is not thread-safe
+    the data is passed to the library directly without pickling
+    Arguments:
+        data: numpy ndarray
+           input data, must have the same shape and dtype in all the nodes
+    Returns:
+        the result of allgather, an array of shape (world_size,) + data.shape,
+        whose i-th row is the data of node i
+    """
+    if not isinstance(data, np.ndarray):
+        raise Exception('allgather only takes in numpy.ndarray')
+    nproc = get_world_size()
+    buf = np.empty((nproc,) + data.shape, dtype = data.dtype)
+    buf[get_rank()] = data
+    rbtlib.RabitAllgather(buf.ctypes.data_as(ctypes.c_void_p),
+                          ctypes.c_ulong(data.nbytes))
+    check_err__()
+    return buf
+
+def allgatherv(data):
+    """
+    gather data of different size from all the nodes, this function is not thread-safe
+    the data is passed to the library directly without pickling
+    Arguments:
+        data: numpy ndarray
+           input data, the size can be different in each node, the dtype must be the same
+    Returns:
+        (result, counts), result is the 1-D concatenation of the data of all the nodes ordered by rank,
+        counts[i] is the number of elements of node i
+    """
+    if not isinstance(data, np.ndarray):
+        raise Exception('allgatherv only takes in numpy.ndarray')
+    rank = get_rank()
+    counts = np.zeros(get_world_size(), dtype = np.uint64)
+    counts[rank] = data.size
+    counts = allgather(counts[rank:rank + 1]).ravel()
+    sizes = (ctypes.c_ulong * len(counts))()
+    sizes[:] = [int(c) * data.itemsize for c in counts]
+    begin = int(counts[:rank].sum())
+    buf = np.empty(int(counts.sum()), dtype = data.dtype)
+    buf[begin : begin + data.size] = data.ravel()
+    rbtlib.RabitAllgatherv(buf.ctypes.data_as(ctypes.c_void_p), sizes)
+    check_err__()
+    return buf, counts
+
+
 def load_model__(ptr, length):
     """
     Internal function used by the module,
@@ -4,6 +4,7 @@
 
 #include <cstring>
 #include <string>
+#include <vector>
 #include "../include/rabit.h"
 #include "./rabit_wrapper.h"
 namespace rabit {
@@ -186,6 +187,15 @@ extern "C" {
                       rbt_ulong size, int root) {
     rabit::Broadcast(sendrecv_data, size, root);
   }
+  void RabitAllgather(void *sendrecvbuf,
+                      rbt_ulong size) {
+    rabit::engine::GetIdleEngine()->Allgather(sendrecvbuf, size);
+  }
+  void RabitAllgatherv(void *sendrecvbuf,
+                       const rbt_ulong *sizes) {
+    std::vector<size_t> sz(sizes, sizes + rabit::GetWorldSize());
+    rabit::engine::GetIdleEngine()->Allgatherv(sendrecvbuf, sz);
+  }
   void RabitAllreduce(void *sendrecvbuf,
                       size_t count,
                       int enum_dtype,
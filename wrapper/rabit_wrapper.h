@@ -57,6 +57,24 @@ extern "C" {
    */
   RABIT_DLL void RabitBroadcast(void *sendrecv_data,
                                 rbt_ulong size, int root);
+  /*!
+   * \brief perform in-place allgather, on sendrecvbuf
+   *   the buffer contains one block of size bytes for each process ordered by rank,
+   *   each process fills in its own block, after the call every process has all the blocks
+   * \param sendrecvbuf buffer for both sending and recving data
+   * \param size the size of the block of each process in bytes
+   */
+  RABIT_DLL void RabitAllgather(void *sendrecvbuf,
+                                rbt_ulong size);
+  /*!
+   * \brief perform in-place allgather, on sendrecvbuf,
+   *   where the blocks of processes can have different sizes
+   * \param sendrecvbuf buffer for both sending and recving data
+   * \param sizes array of the size of the block of each process in bytes,
+   *   the length of the array is the number of processes
+   */
+  RABIT_DLL void RabitAllgatherv(void *sendrecvbuf,
+                                 const rbt_ulong *sizes);
   /*!
    * \brief perform in-place allreduce, on sendrecvbuf 
    *        this function is NOT thread-safe